@@ -1,49 +1,145 @@
 #include "algorithms.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <memory>
+#include <mutex>
 #include <numbers>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "fft.h"
 #include "image.h"
+#include "planar_image.h"
+#include "philox.h"
+#include "pixel_kernels.h"
+#include "progress.h"
+#include "scratch_arena.h"
+#include "thread_pool.h"
+#include "tiled_image.h"
+#include "typed_image.h"
 #include "utility.h"
 
+// output of an operation writing into out_image: in place when out_image is image, a new image otherwise
+static ImageView prepare_output(const std::shared_ptr<Image> &image, const std::shared_ptr<Image> &out_image,
+        Image::InitMode init_mode) {
+    if (out_image != image)
+        out_image->init(image->getImageWidth(), image->getImageHeight(), init_mode);
+    return out_image->view();
+}
+
+// output of a planar operation: in place when out_image is image, the size of the input otherwise
+static void prepare_output(const PlanarRGBA8Image &image, PlanarRGBA8Image &out_image) {
+    if (&out_image != &image && (out_image.getImageWidth() != image.getImageWidth()
+            || out_image.getImageHeight() != image.getImageHeight()))
+        out_image.init(image.getImageWidth(), image.getImageHeight(), Image::INIT_UNINITIALIZED);
+}
+
+// announce units of work (rows or tiles) to an optional progress
+static void add_progress_total(Progress *progress, int64_t units) {
+    if (progress != nullptr)
+        progress->addTotal(units);
+}
+
+static void normalize_histogram(const int *level_count, float *histogram) {
+    const int max_num = *std::max_element(level_count, level_count + 256);
+    for (int i = 0; i < 256; ++i) {
+        histogram[i] = (double) level_count[i] / max_num;
+    }
+}
+
 uint8_t to_gray_average(const uint8_t *pixel) {
     int a = round((((int) pixel[Image::R]) + ((int) pixel[Image::G]) + ((int) pixel[Image::B])) / 3.0f);
     // std::cout << a << std::endl;
     return a;
 }
 
-void generate_gray_image_and_histogram(const std::shared_ptr<Image> image, std::shared_ptr<Image> out_image, float *histogram) {
-    if (out_image != nullptr)
-        out_image->init(image->getImageWidth(), image->getImageHeight());
+// gray conversion into RGB (keeping alpha) or a single channel, counting the gray levels
+template <int C>
+static void convert_to_gray_and_count(ConstImageView image, BasicImageView<uint8_t, C> out_image, int *level_count,
+        Progress *progress) {
+    const bool has_output = !out_image.empty();
+    const PixelKernels &kernels = get_pixel_kernels();
+    std::mutex level_count_mutex;
+
+    parallel_for_rows(image.getImageWidth(), image.getImageHeight(), [&](int y_begin, int y_end) {
+        int band_level_count[256] = {};
+        ScratchScope scratch;
+        uint8_t *row_levels = scratch.arena().allocate<uint8_t>(image.getImageWidth());
+        for (int y = y_begin; y < y_end; ++y) {
+            // a gray output row receives the levels directly
+            uint8_t *levels = (C == 1 && has_output) ? out_image.row(y) : row_levels;
+            kernels.gray_row(image.row(y), levels, image.getImageWidth());
+            kernels.count_levels(levels, image.getImageWidth(), band_level_count);
+            if (C == 4 && has_output) {
+                uint8_t *out_row = out_image.row(y);
+                for (int x = 0; x < image.getImageWidth(); ++x) {
+                    for (int c = 0; c < 3; ++c)
+                        out_row[x * 4 + c] = levels[x];
+                }
+            }
+        }
 
+        // merge the counts of the band
+        std::lock_guard<std::mutex> lock(level_count_mutex);
+        for (int i = 0; i < 256; ++i)
+            level_count[i] += band_level_count[i];
+    }, progress);
+}
+
+void generate_gray_image_and_histogram(ConstImageView image, ImageView out_image, float *histogram, Progress *progress) {
     int level_count[256] = {};
+    add_progress_total(progress, image.getImageHeight());
 
     // transform to gray scale
-    for (int y = 0; y < image->getImageHeight(); ++y) {
-        for (int x = 0; x < image->getImageWidth(); ++x) {
-            const uint8_t gray_level = to_gray_average(image->pixel(x, y));
-            ++level_count[gray_level];
-            if (out_image != nullptr) {
-                out_image->pixel(x, y)[Image::R] = gray_level;
-                out_image->pixel(x, y)[Image::G] = gray_level;
-                out_image->pixel(x, y)[Image::B] = gray_level;
-            }
-        }
-    }
-    if (out_image != nullptr) {
-        out_image->loadToTexture();
-    }
+    convert_to_gray_and_count<4>(image, out_image, level_count, progress);
 
     // normalize histogram
-    if (histogram != nullptr) {
-        const int max_num = *std::max_element(level_count, level_count + 256);
+    if (histogram != nullptr && !is_canceled(progress))
+        normalize_histogram(level_count, histogram);
+}
 
-        for (int i = 0; i < 256; ++i) {
-            histogram[i] = (double) level_count[i] / max_num;
-        }
+void generate_gray_image_and_histogram(ConstImageView image, Gray8View out_image, float *histogram, Progress *progress) {
+    int level_count[256] = {};
+    add_progress_total(progress, image.getImageHeight());
+
+    // transform to gray scale, one byte per pixel
+    convert_to_gray_and_count<1>(image, out_image, level_count, progress);
+
+    // normalize histogram
+    if (histogram != nullptr && !is_canceled(progress))
+        normalize_histogram(level_count, histogram);
+}
+
+void generate_gray_image_and_histogram(const std::shared_ptr<Image> image, std::shared_ptr<Image> out_image, float *histogram,
+        Progress *progress) {
+    if (out_image == nullptr) {
+        generate_gray_image_and_histogram(std::as_const(*image).view(), ImageView(), histogram, progress);
+        return;
     }
+
+    const ImageView out_view = prepare_output(image, out_image, Image::INIT_WHITE);
+    generate_gray_image_and_histogram(out_image == image ? out_view : std::as_const(*image).view(), out_view, histogram,
+            progress);
+}
+
+void convert_to_gray(ConstImageView image, ImageView out_image) {
+    generate_gray_image_and_histogram(image, out_image, nullptr);
+}
+
+void convert_to_gray(const TiledImage &image, TiledImage &out_image) {
+    if (&out_image != &image)
+        out_image.init(image.getImageWidth(), image.getImageHeight());
+    out_image.parallelForEachTile([&](ImageView out_tile, int64_t x, int64_t y) {
+        convert_to_gray(image.tile(x / TiledImage::tile_size, y / TiledImage::tile_size), out_tile);
+    });
+}
+
+void convert_to_gray(const std::shared_ptr<Image> image, std::shared_ptr<Image> out_image) {
+    generate_gray_image_and_histogram(image, out_image, nullptr);
 }
 
 std::shared_ptr<Image> generate_histogram_image(const float *histogram) {
@@ -68,105 +164,283 @@ std::shared_ptr<Image> generate_histogram_image(const float *histogram) {
             image->pixel(histogram_start + level, y)[Image::B] = 0;
         }
     }
-    image->loadToTexture();
     return image;
 }
 
-void generate_gaussian_noise(float *out_noise, int count, float sigma) {
+// values 2 * pair and 2 * pair + 1 of the noise of the seed
+static void generate_gaussian_noise_pair(uint64_t seed, int64_t pair, float sigma, float *out_pair) {
     using std::numbers::pi;
 
-    for (int i = 0; i < count; i += 2) {
-        // generate uniform random number pairs
-        const double r = random_float();
-        const double phi = random_float();
+    // generate uniform random number pairs
+    const PhiloxCounter bits = philox_random(seed, pair);
+    const double r = philox_uniform(bits[0], bits[1]);
+    const double phi = philox_uniform(bits[2], bits[3]);
+
+    // Box-Muller transform
+    const double ln_r = (r == 0.) ? 0. : log(r);
+    out_pair[0] = sigma * cos(2. * pi * phi) * sqrt(-2. * ln_r);
+    out_pair[1] = sigma * sin(2. * pi * phi) * sqrt(-2. * ln_r);
+}
 
-        // Box-Muller transform
-        const double ln_r = (r == 0.) ? 0. : log(r);
-        const double z1 = sigma * cos(2. * pi * phi) * sqrt(-2. * ln_r);
-        const double z2 = sigma * sin(2. * pi * phi) * sqrt(-2. * ln_r);
+void generate_gaussian_noise(float *out_noise, int64_t count, float sigma, uint64_t seed, Progress *progress) {
+    // one pair of values per counter value, so any range of pairs can be generated independently;
+    // the loop runs over blocks of pairs, whose count fits an int for any image
+    constexpr int64_t block_pairs = 8192;
+    const int block_count = (int) (((count + 1) / 2 + block_pairs - 1) / block_pairs);
+    add_progress_total(progress, block_count);
+    parallel_for(0, block_count, 1, [&](int block_begin, int block_end) {
+        const int64_t begin = 2 * block_pairs * block_begin;
+        const int64_t end = std::min(2 * block_pairs * block_end, count);
+        generate_gaussian_noise_range(out_noise + begin, begin, end, sigma, seed);
+    }, progress);
+}
 
-        // save noise
-        out_noise[i] = z1;
-        if (i + 1 < count)
-            out_noise[i + 1] = z2;
+void generate_gaussian_noise_range(float *out_noise, int64_t begin, int64_t end, float sigma, uint64_t seed) {
+    float pair_noise[2];
+    for (int64_t i = begin; i < end; ) {
+        generate_gaussian_noise_pair(seed, i / 2, sigma, pair_noise);
+        // a range may start or end in the middle of a pair
+        for (int j = (int) (i % 2); j < 2 && i < end; ++j, ++i)
+            out_noise[i - begin] = pair_noise[j];
     }
 }
 
-void generate_histogram_from_array(const float *noise, int count, float *histogram) {
+void add_noise(ConstImageView image, ImageView out_image, const float *noise, Progress *progress) {
+    const PixelKernels &kernels = get_pixel_kernels();
+    add_progress_total(progress, image.getImageHeight());
+    parallel_for_rows(image.getImageWidth(), image.getImageHeight(), [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y) {
+            const float *row_noise = noise + (std::ptrdiff_t) y * image.getImageWidth();
+            kernels.add_noise_row(image.row(y), out_image.row(y), image.getImageWidth(), row_noise);
+        }
+    }, progress);
+}
+
+void add_noise(const PlanarRGBA8Image &image, PlanarRGBA8Image &out_image, const float *noise, Progress *progress) {
+    prepare_output(image, out_image);
+    const int width = image.getImageWidth();
+    add_progress_total(progress, image.getImageHeight());
+    parallel_for_rows(width, image.getImageHeight(), [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y) {
+            // each color plane like add_noise_row, alpha kept
+            const float *row_noise = noise + (std::ptrdiff_t) y * width;
+            for (int c = Image::R; c <= Image::B; ++c) {
+                const uint8_t *row = image.plane(c).row(y);
+                uint8_t *out_row = out_image.plane(c).row(y);
+                for (int x = 0; x < width; ++x)
+                    out_row[x] = clamp(row[x] + 255 * row_noise[x], 0.f, 255.f);
+            }
+            if (&out_image != &image)
+                memcpy(out_image.plane(Image::A).row(y), image.plane(Image::A).row(y), width);
+        }
+    }, progress);
+}
+
+void add_noise(const std::shared_ptr<Image> image, std::shared_ptr<Image> out_image, const float *noise,
+        Progress *progress) {
+    const ImageView out_view = prepare_output(image, out_image, Image::INIT_UNINITIALIZED);
+    add_noise(out_image == image ? out_view : std::as_const(*image).view(), out_view, noise, progress);
+}
+
+static void apply_lookup_table_with_progress(ConstImageView image, ImageView out_image, const uint8_t *lut,
+        Progress *progress) {
+    const PixelKernels &kernels = get_pixel_kernels();
+    parallel_for_rows(image.getImageWidth(), image.getImageHeight(), [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y)
+            kernels.lookup_table_row(image.row(y), out_image.row(y), image.getImageWidth(), lut);
+    }, progress);
+}
+
+void apply_lookup_table(ConstImageView image, ImageView out_image, const uint8_t *lut) {
+    apply_lookup_table_with_progress(image, out_image, lut, nullptr);
+}
+
+void apply_lookup_table(const std::shared_ptr<Image> image, std::shared_ptr<Image> out_image, const uint8_t *lut) {
+    const ImageView out_view = prepare_output(image, out_image, Image::INIT_UNINITIALIZED);
+    apply_lookup_table(out_image == image ? out_view : std::as_const(*image).view(), out_view, lut);
+}
+
+static void apply_lookup_table_with_progress(const TiledImage &image, TiledImage &out_image, const uint8_t *lut,
+        Progress *progress) {
+    if (&out_image != &image)
+        out_image.init(image.getImageWidth(), image.getImageHeight(), Image::INIT_UNINITIALIZED);
+    out_image.parallelForEachTile([&](ImageView out_tile, int64_t x, int64_t y) {
+        apply_lookup_table(image.tile(x / TiledImage::tile_size, y / TiledImage::tile_size), out_tile, lut);
+    }, progress);
+}
+
+void apply_lookup_table(const TiledImage &image, TiledImage &out_image, const uint8_t *lut) {
+    apply_lookup_table_with_progress(image, out_image, lut, nullptr);
+}
+
+void generate_histogram_from_array(const float *noise, int64_t count, float *histogram, float offset) {
     int level_count[256] = {};
 
     // transform to gray scale
-    for (int i = 0; i < count; ++i) {
-        const uint8_t gray_level = 255 * clamp(noise[i], 0.f, 1.f);
+    for (int64_t i = 0; i < count; ++i) {
+        const uint8_t gray_level = 255 * clamp(noise[i] + offset, 0.f, 1.f);
         ++level_count[gray_level];
     }
 
     // normalize histogram
-    const int max_num = *std::max_element(level_count, level_count + 256);
-    for (int i = 0; i < 256; ++i) {
-        histogram[i] = (double) level_count[i] / max_num;
-    }
+    normalize_histogram(level_count, histogram);
 }
 
-std::shared_ptr<Image> haar_wavelet_transform(const std::shared_ptr<Image> image, int level, float scale) {
-    if (level < 0) return nullptr;
-    if (level == 0) return std::make_shared<Image>(*image);
+// one channel haar wavelet transform; integer levels are truncated and clamped like 8-bit pixels, float levels are exact
+template <typename T>
+static void haar_wavelet_transform_gray(BasicImageView<const T, 1> image, BasicImageView<T, 1> out_image, int level, float scale,
+        Progress *progress) {
+    if (out_image.data() != image.data())
+        copy_pixels(image, out_image);
 
-    int cur_w = image->getImageWidth();
-    int cur_h = image->getImageHeight();
+    int cur_w = image.getImageWidth();
+    int cur_h = image.getImageHeight();
 
-    std::shared_ptr<Image> in_image = image;
-    std::shared_ptr<Image> out_image = image;
+    // coefficients of the previous level, which are overwritten in place; each level fits in the first one
+    ScratchScope scratch;
+    T *in_pixels = scratch.arena().allocate<T>((std::size_t) cur_w * cur_h);
 
-    for (int current_level = 0; current_level < level; ++current_level) {
-        out_image = std::make_shared<Image>(*in_image);
+    for (int current_level = 0; current_level < level && !is_canceled(progress); ++current_level) {
+        const BasicImageView<T, 1> in_image(in_pixels, cur_w, cur_h);
+        copy_pixels(BasicImageView<const T, 1>(out_image.subview(0, 0, cur_w, cur_h)), in_image);
         const int half_w = cur_w / 2;
         const int half_h = cur_h / 2;
 
-        for (int y = 0; y < half_h; ++y) {
-            for (int x = 0; x < half_w; ++x) {
-                const uint8_t a = in_image->pixel(2 * x    , 2 * y    )[Image::R];
-                const uint8_t b = in_image->pixel(2 * x + 1, 2 * y    )[Image::R];
-                const uint8_t c = in_image->pixel(2 * x    , 2 * y + 1)[Image::R];
-                const uint8_t d = in_image->pixel(2 * x + 1, 2 * y + 1)[Image::R];
-
-                const uint8_t ll = clamp((int) (   ((int) a + (int) b + (int) c + (int) d) / 4                ), 0, 255);
-                const uint8_t hl = clamp((int) (abs((int) a - (int) b + (int) c - (int) d) / 4 * scale        ), 0, 255);
-                const uint8_t lh = clamp((int) (abs((int) a + (int) b - (int) c - (int) d) / 4 * scale        ), 0, 255);
-                const uint8_t hh = clamp((int) (abs((int) a - (int) b - (int) c + (int) d) / 4 * scale * scale), 0, 255);
-
-                out_image->pixel(         x,          y)[Image::R] = ll;  // LL (left-top)
-                out_image->pixel(half_w + x,          y)[Image::R] = hl;  // HL (right-top)
-                out_image->pixel(         x, half_h + y)[Image::R] = lh;  // LH (left-bottom)
-                out_image->pixel(half_w + x, half_h + y)[Image::R] = hh;  // HH (right-bottom)
+        parallel_for_rows(half_w, half_h, [&](int y_begin, int y_end) {
+            for (int y = y_begin; y < y_end; ++y) {
+                for (int x = 0; x < half_w; ++x) {
+                    const T a = in_image.pixel(2 * x    , 2 * y    )[0];
+                    const T b = in_image.pixel(2 * x + 1, 2 * y    )[0];
+                    const T c = in_image.pixel(2 * x    , 2 * y + 1)[0];
+                    const T d = in_image.pixel(2 * x + 1, 2 * y + 1)[0];
+
+                    T ll, hl, lh, hh;
+                    if constexpr (std::is_floating_point_v<T>) {
+                        ll =      (a + b + c + d) / 4;
+                        hl = std::abs(a - b + c - d) / 4 * scale;
+                        lh = std::abs(a + b - c - d) / 4 * scale;
+                        hh = std::abs(a - b - c + d) / 4 * scale * scale;
+                    } else {
+                        ll = clamp((int) (   ((int) a + (int) b + (int) c + (int) d) / 4                ), 0, 255);
+                        hl = clamp((int) (abs((int) a - (int) b + (int) c - (int) d) / 4 * scale        ), 0, 255);
+                        lh = clamp((int) (abs((int) a + (int) b - (int) c - (int) d) / 4 * scale        ), 0, 255);
+                        hh = clamp((int) (abs((int) a - (int) b - (int) c + (int) d) / 4 * scale * scale), 0, 255);
+                    }
+
+                    out_image.pixel(         x,          y)[0] = ll;  // LL (left-top)
+                    out_image.pixel(half_w + x,          y)[0] = hl;  // HL (right-top)
+                    out_image.pixel(         x, half_h + y)[0] = lh;  // LH (left-bottom)
+                    out_image.pixel(half_w + x, half_h + y)[0] = hh;  // HH (right-bottom)
+                }
             }
-        }
+        }, progress);
 
         cur_w = half_w;
         cur_h = half_h;
-        in_image = out_image;
     }
+}
+
+// rows processed by haar_wavelet_transform_gray, the units of its progress
+static int64_t haar_wavelet_transform_rows(int height, int level) {
+    int64_t rows = 0;
+    for (int current_level = 0; current_level < level; ++current_level) {
+        height /= 2;
+        rows += height;
+    }
+    return rows;
+}
+
+void haar_wavelet_transform(ConstGray8View image, Gray8View out_image, int level, float scale, Progress *progress) {
+    add_progress_total(progress, haar_wavelet_transform_rows(image.getImageHeight(), level));
+    haar_wavelet_transform_gray<uint8_t>(image, out_image, level, scale, progress);
+}
+
+void haar_wavelet_transform(ConstGray32FView image, Gray32FView out_image, int level, float scale, Progress *progress) {
+    add_progress_total(progress, haar_wavelet_transform_rows(image.getImageHeight(), level));
+    haar_wavelet_transform_gray<float>(image, out_image, level, scale, progress);
+}
+
+void haar_wavelet_transform(ConstImageView image, ImageView out_image, int level, float scale, Progress *progress) {
+    copy_pixels(image, out_image);
+    if (level == 0)
+        return;
+
+    // transform the red channel only
+    ScratchScope scratch;
+    const Gray8View red = scratch.arena().allocateImage<uint8_t, 1>(image.getImageWidth(), image.getImageHeight());
+    deinterleave(image, &red, 1);
+    const Gray8View result = scratch.arena().allocateImage<uint8_t, 1>(image.getImageWidth(), image.getImageHeight());
+    haar_wavelet_transform(ConstGray8View(red), result, level, scale, progress);
+    if (is_canceled(progress))
+        return;
 
     // fill other color in pixels
-    for (int y = 0; y < out_image->getImageHeight(); ++y) {
-        for (int x = 0; x < out_image->getImageWidth(); ++x) {
-            const uint8_t color = out_image->pixel(x, y)[Image::R];
-            out_image->pixel(x, y)[Image::G] = color;
-            out_image->pixel(x, y)[Image::B] = color;
+    for (int y = 0; y < out_image.getImageHeight(); ++y) {
+        for (int x = 0; x < out_image.getImageWidth(); ++x) {
+            const uint8_t color = result.pixel(x, y)[0];
+            out_image.pixel(x, y)[Image::R] = color;
+            out_image.pixel(x, y)[Image::G] = color;
+            out_image.pixel(x, y)[Image::B] = color;
         }
     }
+}
+
+void haar_wavelet_transform(const PlanarRGBA8Image &image, PlanarRGBA8Image &out_image, int level, float scale,
+        Progress *progress) {
+    prepare_output(image, out_image);
+    if (&out_image != &image) {
+        // level 0 keeps the color planes, other levels replace them
+        for (int c = level == 0 ? Image::R : Image::A; c <= Image::A; ++c)
+            copy_pixels(image.plane(c), out_image.plane(c));
+    }
+    if (level == 0)
+        return;
+
+    // the red plane transformed in place or into the output, then copied to green and blue
+    haar_wavelet_transform(image.plane(Image::R), out_image.plane(Image::R), level, scale, progress);
+    if (is_canceled(progress))
+        return;
+    copy_pixels(std::as_const(out_image).plane(Image::R), out_image.plane(Image::G));
+    copy_pixels(std::as_const(out_image).plane(Image::R), out_image.plane(Image::B));
+}
+
+std::shared_ptr<Image> haar_wavelet_transform(const std::shared_ptr<Image> image, int level, float scale, Progress *progress) {
+    if (level < 0) return nullptr;
+
+    std::shared_ptr<Image> out_image = std::make_shared<Image>(
+            image->getImageWidth(), image->getImageHeight(), Image::INIT_UNINITIALIZED);
+    haar_wavelet_transform(std::as_const(*image).view(), out_image->view(), level, scale, progress);
+    return is_canceled(progress) ? nullptr : out_image;
+}
+
+std::shared_ptr<Image> gray_haar_wavelet_transform(const std::shared_ptr<Image> image, int level, float scale,
+        Progress *progress) {
+    if (level < 0) return nullptr;
 
+    // to gray, one byte per pixel
+    Gray8Image in_image(image->getImageWidth(), image->getImageHeight(), Image::INIT_UNINITIALIZED);
+    generate_gray_image_and_histogram(std::as_const(*image).view(), in_image.view(), nullptr, progress);
+    if (is_canceled(progress))
+        return nullptr;
+
+    // resize image
+    in_image.resize(
+        nearest_power_of_2(in_image.getImageWidth()),
+        nearest_power_of_2(in_image.getImageHeight()));
+
+    Gray8Image out_gray_image(in_image.getImageWidth(), in_image.getImageHeight(), Image::INIT_UNINITIALIZED);
+    haar_wavelet_transform(std::as_const(in_image).view(), out_gray_image.view(), level, scale, progress);
+    if (is_canceled(progress))
+        return nullptr;
+
+    // expand to RGBA
+    std::shared_ptr<Image> out_image = std::make_shared<Image>(
+            out_gray_image.getImageWidth(), out_gray_image.getImageHeight(), Image::INIT_UNINITIALIZED);
+    convert_pixels(std::as_const(out_gray_image).view(), out_image->view());
     return out_image;
 }
 
-std::shared_ptr<Image> histogram_equalization(const std::shared_ptr<Image> image) {
-    // compute the histogram
-    int histogram[256] = {};
-    for (int y = 0; y < image->getImageHeight(); y++) {
-        for (int x = 0; x < image->getImageHeight(); x++) {
-            ++histogram[image->pixel(x, y)[Image::R]];
-        }
-    }
+void compute_equalization_map(int64_t *histogram, uint8_t *transform_map) {
     int g_min = 0;
     while (g_min < 256 && histogram[g_min] == 0) {
         ++g_min;
@@ -176,101 +450,624 @@ std::shared_ptr<Image> histogram_equalization(const std::shared_ptr<Image> image
     for (int g = 1; g < 256; ++g) {
         histogram[g] += histogram[g - 1];
     }
-    const int h_min = histogram[g_min];
+    const int64_t h_min = histogram[g_min];
 
     // compute map
-    uint8_t transform_map[256] = {};
-    const double const_part = 255.0 / (image->getImageWidth() * image->getImageHeight() - h_min);
+    const double const_part = 255.0 / (histogram[255] - h_min);
     for (int g = 0; g < 256; ++g) {
         transform_map[g] = clamp(round((histogram[g] - h_min) * const_part), 0.0, 255.0);
     }
+}
+
+void histogram_equalization(ConstImageView image, ImageView out_image, Progress *progress) {
+    // two passes over the rows
+    add_progress_total(progress, 2 * (int64_t) image.getImageHeight());
+
+    // compute the histogram
+    int64_t histogram[256] = {};
+    std::mutex histogram_mutex;
+    parallel_for_rows(image.getImageWidth(), image.getImageHeight(), [&](int y_begin, int y_end) {
+        int64_t band_histogram[256] = {};
+        for (int y = y_begin; y < y_end; y++) {
+            for (int x = 0; x < image.getImageWidth(); x++) {
+                ++band_histogram[image.pixel(x, y)[Image::R]];
+            }
+        }
+        std::lock_guard<std::mutex> lock(histogram_mutex);
+        for (int g = 0; g < 256; ++g)
+            histogram[g] += band_histogram[g];
+    }, progress);
+    if (is_canceled(progress))
+        return;
+
+    uint8_t transform_map[256] = {};
+    compute_equalization_map(histogram, transform_map);
 
     // map color to new image
-    std::shared_ptr<Image> result = std::make_shared<Image>(image->getImageWidth(), image->getImageHeight());
-    for (int y = 0; y < image->getImageHeight(); ++y) {
-        for (int x = 0; x < image->getImageWidth(); ++x) {
-            result->pixel(x, y)[Image::R] = transform_map[image->pixel(x, y)[Image::R]];
-            result->pixel(x, y)[Image::G] = transform_map[image->pixel(x, y)[Image::G]];
-            result->pixel(x, y)[Image::B] = transform_map[image->pixel(x, y)[Image::B]];
-            result->pixel(x, y)[Image::A] = image->pixel(x, y)[Image::A];
+    apply_lookup_table_with_progress(image, out_image, transform_map, progress);
+}
+
+void histogram_equalization(const TiledImage &image, TiledImage &out_image, Progress *progress) {
+    // two passes over the tiles
+    add_progress_total(progress, 2 * image.getTileCountX() * image.getTileCountY());
+
+    // compute the histogram over all tiles
+    int64_t histogram[256] = {};
+    std::mutex histogram_mutex;
+    image.parallelForEachTile([&](ConstImageView tile, int64_t, int64_t) {
+        int64_t tile_histogram[256] = {};
+        for (int y = 0; y < tile.getImageHeight(); ++y) {
+            const uint8_t *row = tile.row(y);
+            for (int x = 0; x < tile.getImageWidth(); ++x)
+                ++tile_histogram[row[x * 4 + Image::R]];
         }
+        std::lock_guard<std::mutex> lock(histogram_mutex);
+        for (int g = 0; g < 256; ++g)
+            histogram[g] += tile_histogram[g];
+    }, progress);
+    if (is_canceled(progress))
+        return;
+
+    uint8_t transform_map[256] = {};
+    compute_equalization_map(histogram, transform_map);
+
+    // map color to new image
+    apply_lookup_table_with_progress(image, out_image, transform_map, progress);
+}
+
+std::shared_ptr<Image> histogram_equalization(const std::shared_ptr<Image> image, Progress *progress) {
+    std::shared_ptr<Image> result = std::make_shared<Image>();
+    histogram_equalization(image, result, progress);
+    return is_canceled(progress) ? nullptr : result;
+}
+
+void histogram_equalization(const std::shared_ptr<Image> image, std::shared_ptr<Image> out_image, Progress *progress) {
+    const ImageView out_view = prepare_output(image, out_image, Image::INIT_UNINITIALIZED);
+    histogram_equalization(out_image == image ? out_view : std::as_const(*image).view(), out_view, progress);
+}
+
+int64_t map_edge_coordinate(int64_t coordinate, int64_t size, ConvolutionEdgeHandlingMethod edge_handling_method) {
+    if (coordinate >= 0 && coordinate < size)
+        return coordinate;
+
+    if (edge_handling_method == ConvolutionEdgeHandlingMethod::EXTEND) {
+        return clamp<int64_t>(coordinate, 0, size - 1);
+    } else if (edge_handling_method == ConvolutionEdgeHandlingMethod::WRAP) {
+        return (coordinate % size + size) % size;
+    } else {  // MIRROR
+        const int64_t mapped = coordinate < 0 ? -coordinate - 1 : size - (coordinate - size) - 1;
+        return clamp<int64_t>(mapped, 0, size - 1);
     }
+}
+
+/*
+ * Edge handling of the convolution without a padded copy of the image.
+ *
+ * Rows and columns read for the coordinates [-half_kernel_size, size +
+ * half_kernel_size) come from tables made once per call. Output pixels at
+ * least half_kernel_size from the left and right edges read their taps
+ * straight from the image rows, the few pixels near the edges read them
+ * from a strip gathered through the column table.
+ */
+struct ConvolutionEdges {
+    int half_kernel_size;
+    const int *rows;
+    const int *columns;
+    // outputs [interior_begin, interior_end) read no column outside the image
+    int interior_begin;
+    int interior_end;
+    // outputs near the left and right edges, the widest is half_kernel_size pixels
+    int border_ranges[2][2];
+
+    ConvolutionEdges(ScratchArena &arena, int width, int height, int kernel_size,
+            ConvolutionEdgeHandlingMethod edge_handling_method) : half_kernel_size(kernel_size / 2) {
+        int *row_table = arena.allocate<int>(height + 2 * half_kernel_size);
+        for (int i = 0; i < height + 2 * half_kernel_size; ++i)
+            row_table[i] = (int) map_edge_coordinate(i - half_kernel_size, height, edge_handling_method);
+        int *column_table = arena.allocate<int>(width + 2 * half_kernel_size);
+        for (int i = 0; i < width + 2 * half_kernel_size; ++i)
+            column_table[i] = (int) map_edge_coordinate(i - half_kernel_size, width, edge_handling_method);
+        rows = row_table;
+        columns = column_table;
+
+        const int left_end = std::min(half_kernel_size, width);
+        interior_begin = left_end;
+        interior_end = std::max(width - half_kernel_size, left_end);
+        border_ranges[0][0] = 0;
+        border_ranges[0][1] = left_end;
+        border_ranges[1][0] = interior_end;
+        border_ranges[1][1] = width;
+    }
+
+    // pixels of an image row read by the outputs [x_begin, x_end), in the order of the taps
+    template <int C>
+    void gatherTaps(const uint8_t *row, int x_begin, int x_end, uint8_t *out_taps) const {
+        for (int i = 0; i < x_end - x_begin + 2 * half_kernel_size; ++i)
+            std::memcpy(out_taps + i * C, row + columns[x_begin + i] * C, C);
+    }
+};
+
+// convolution as a horizontal pass into float rows and a vertical pass over them
+template <int C>
+static void convolve_separable(BasicImageView<const uint8_t, C> image, BasicImageView<uint8_t, C> out_image,
+        const ConvolutionEdges &edges, int kernel_size, const float *column, const float *row, Progress *progress) {
+    const int width = image.getImageWidth();
+    const int height = image.getImageHeight();
+    const int row_values = width * C;
+
+    // the weights in the order of the taps, the factors flipped
+    ScratchScope scratch;
+    float *column_weights = scratch.arena().allocate<float>(kernel_size);
+    float *row_weights = scratch.arena().allocate<float>(kernel_size);
+    std::reverse_copy(column, column + kernel_size, column_weights);
+    std::reverse_copy(row, row + kernel_size, row_weights);
+    const PixelKernels &kernels = get_pixel_kernels();
+
+    // bands of at least a few times the kernel height, each band sums kernel_size - 1 rows more than it outputs
+    const int min_rows = std::max({1, 16384 / std::max(width, 1), 4 * kernel_size});
+    const int balanced_rows = height / (4 * ThreadPool::instance().getThreadCount());
+    parallel_for(0, height, std::max(min_rows, balanced_rows), [&](int y_begin, int y_end) {
+        ScratchScope band_scratch;
+        const int sum_rows = y_end - y_begin + kernel_size - 1;
+        float *sums = band_scratch.arena().allocate<float>((std::size_t) sum_rows * row_values);
+        const float **rows = band_scratch.arena().allocate<const float *>(kernel_size);
+        uint8_t *taps = band_scratch.arena().allocate<uint8_t>((std::size_t) 3 * edges.half_kernel_size * C);
 
-    result->loadToTexture();
+        // horizontal pass over the rows of the band and its taps above and below
+        for (int i = 0; i < sum_rows; ++i) {
+            const uint8_t *in_row = image.row(edges.rows[y_begin + i]);
+            float *sum_row = sums + (std::ptrdiff_t) i * row_values;
+            if (edges.interior_begin < edges.interior_end)
+                kernels.convolve_horizontal(in_row + (edges.interior_begin - edges.half_kernel_size) * C, C,
+                        kernel_size, row_weights, sum_row + edges.interior_begin * C,
+                        (edges.interior_end - edges.interior_begin) * C);
+            for (const auto &[x_begin, x_end] : edges.border_ranges) {
+                if (x_begin == x_end)
+                    continue;
+                edges.gatherTaps<C>(in_row, x_begin, x_end, taps);
+                kernels.convolve_horizontal(taps, C, kernel_size, row_weights, sum_row + x_begin * C, (x_end - x_begin) * C);
+            }
+        }
 
-    return result;
+        // vertical pass
+        for (int y = y_begin; y < y_end; ++y) {
+            for (int i = 0; i < kernel_size; ++i)
+                rows[i] = sums + (std::ptrdiff_t) (y - y_begin + i) * row_values;
+            uint8_t *out_row = out_image.row(y);
+            kernels.convolve_vertical(rows, kernel_size, column_weights, out_row, row_values);
+            if constexpr (C == 4) {
+                // preserve original alpha channel
+                const uint8_t *in_row = image.row(y);
+                for (int x = 0; x < width; ++x)
+                    out_row[x * 4 + Image::A] = in_row[x * 4 + Image::A];
+            }
+        }
+    }, progress);
 }
 
-std::shared_ptr<Image> image_convolution(const std::shared_ptr<Image> image, int kernel_size, const float *kernel,
-        ConvolutionEdgeHandlingMethod edge_handling_method) {
-    const int half_kernel_size = kernel_size / 2;
+/*
+ * Convolution in the frequency domain, for large kernels whose direct cost
+ * grows with the square of their size.
+ *
+ * The output is cut into tiles of fft_size - kernel_size + 1 pixels. The
+ * fft_size x fft_size inputs of a tile, read through the edge tables, are
+ * transformed, multiplied by the spectrum of the kernel and transformed
+ * back. The circular convolution equals the linear one but in its first
+ * kernel_size - 1 rows and columns, which are dropped (overlap-save).
+ *
+ * Two real planes (color channels of the same tile or of the next one)
+ * go through one complex transform as its real and imaginary parts: the
+ * kernel being real, the real and imaginary parts of the result are the
+ * two planes convolved.
+ *
+ * The color channels are read as planes, with unit stride. Channel c is
+ * written into channel c of the one interleaved out_images (C > 1), or
+ * into the plane out_images[c] (C == 1).
+ */
+template <int C>
+static void convolve_fft(const ConstGray8View *planes, int color_channels, const BasicImageView<uint8_t, C> *out_images,
+        const ConvolutionEdges &edges, int kernel_size, const float *kernel, int fft_size, Progress *progress) {
+    const int width = planes[0].getImageWidth();
+    const int height = planes[0].getImageHeight();
+    const int n = fft_size;
+    const std::size_t square_size = (std::size_t) n * n;
+    const int tile_size = n - kernel_size + 1;
+    const int tile_count_x = (width + tile_size - 1) / tile_size;
+    const int tile_count_y = (height + tile_size - 1) / tile_size;
+    const int row_planes = tile_count_x * color_channels;
+    const int row_transforms = (row_planes + 1) / 2;
+    const SquareFFT fft(n);
+
+    // spectrum of the kernel, with the normalization of the inverse transform
+    ScratchScope scratch;
+    float *kernel_real = scratch.arena().allocate<float>(square_size);
+    float *kernel_imaginary = scratch.arena().allocate<float>(square_size);
+    std::fill(kernel_real, kernel_real + square_size, 0.f);
+    std::fill(kernel_imaginary, kernel_imaginary + square_size, 0.f);
+    const float scale = 1.f / square_size;
+    for (int i = 0; i < kernel_size; ++i) {
+        for (int j = 0; j < kernel_size; ++j)
+            kernel_real[i * n + j] = kernel[i * kernel_size + j] * scale;
+    }
+    fft.forward(kernel_real, kernel_imaginary);
+
+    // the inputs of a tile at extended coordinates [-half_kernel_size, size + half_kernel_size) of the
+    // edge tables, zeros past them, which only outputs past the image read
+    const int extended_width = width + 2 * edges.half_kernel_size;
+    const int extended_height = height + 2 * edges.half_kernel_size;
+
+    parallel_for(0, tile_count_y * row_transforms, 1, [&](int transform_begin, int transform_end) {
+        ScratchScope task_scratch;
+        float *values[2] = {
+            task_scratch.arena().allocate<float>(square_size), task_scratch.arena().allocate<float>(square_size)
+        };
+
+        for (int transform = transform_begin; transform < transform_end; ++transform) {
+            const int y = transform / row_transforms * tile_size;
+            const int first_plane = transform % row_transforms * 2;
+
+            for (int p = 0; p < 2; ++p) {
+                float *plane_values = values[p];
+                if (first_plane + p >= row_planes) {
+                    std::fill(plane_values, plane_values + square_size, 0.f);
+                    continue;
+                }
+                const int x = (first_plane + p) / color_channels * tile_size;
+                const int c = (first_plane + p) % color_channels;
+                const int valid_width = std::min(n, extended_width - x);
+                for (int v = 0; v < n; ++v) {
+                    float *value_row = plane_values + (std::size_t) v * n;
+                    if (y + v >= extended_height) {
+                        std::fill(value_row, value_row + n, 0.f);
+                        continue;
+                    }
+                    const uint8_t *in_row = planes[c].row(edges.rows[y + v]);
+                    for (int u = 0; u < valid_width; ++u)
+                        value_row[u] = in_row[edges.columns[x + u]];
+                    std::fill(value_row + valid_width, value_row + n, 0.f);
+                }
+            }
 
-    // make padded image
-    std::shared_ptr<Image> padded_image = std::make_shared<Image>(
-            image->getImageWidth() + 2 * (kernel_size - 1), image->getImageHeight() + 2 * (kernel_size - 1));
-    padded_image->fill(0);
-
-    const int original_w = image->getImageWidth();
-    const int original_h = image->getImageHeight();
-
-    for (int padded_y = 0; padded_y < padded_image->getImageHeight(); ++padded_y) {
-        const int original_y = padded_y - kernel_size + 1;
-        for (int padded_x = 0; padded_x < padded_image->getImageWidth(); ++padded_x) {
-            const int original_x = padded_x - kernel_size + 1;
-
-            // copy from original pixel
-            int map_x = original_x;
-            int map_y = original_y;
-
-            // edge handling
-            if (original_x < 0 || original_x >= original_w || original_y < 0 || original_y >= original_h) {
-                if (edge_handling_method == ConvolutionEdgeHandlingMethod::EXTEND) {
-                    map_x = clamp(original_x, 0, original_w - 1);
-                    map_y = clamp(original_y, 0, original_h - 1);
-                } else if (edge_handling_method == ConvolutionEdgeHandlingMethod::WRAP) {
-                    map_x = (original_x + original_w) % original_w;
-                    map_y = (original_y + original_h) % original_h;
-                } else if (edge_handling_method == ConvolutionEdgeHandlingMethod::MIRROR) {
-                    if (original_x < 0)            map_x = -original_x - 1;
-                    if (original_x >= original_w ) map_x = original_w - (original_x - original_w) - 1;
-                    if (original_y < 0)            map_y = -original_y - 1;
-                    if (original_y >= original_h ) map_y = original_h - (original_y - original_h) - 1;
+            fft.forward(values[0], values[1]);
+            for (std::size_t i = 0; i < square_size; ++i) {
+                const float real = values[0][i] * kernel_real[i] - values[1][i] * kernel_imaginary[i];
+                const float imaginary = values[0][i] * kernel_imaginary[i] + values[1][i] * kernel_real[i];
+                values[0][i] = real;
+                values[1][i] = imaginary;
+            }
+            fft.inverse(values[0], values[1]);
+
+            for (int p = 0; p < 2 && first_plane + p < row_planes; ++p) {
+                const int x = (first_plane + p) / color_channels * tile_size;
+                const int c = (first_plane + p) % color_channels;
+                const int out_width = std::min(tile_size, width - x);
+                const int out_height = std::min(tile_size, height - y);
+                const BasicImageView<uint8_t, C> &out_image = out_images[C == 1 ? c : 0];
+                for (int v = 0; v < out_height; ++v) {
+                    const float *value_row = values[p] + (std::size_t) (v + kernel_size - 1) * n + kernel_size - 1;
+                    uint8_t *out_row = out_image.row(y + v) + x * C + (C == 1 ? 0 : c);
+                    for (int u = 0; u < out_width; ++u)
+                        out_row[u * C] = clamp(std::round(value_row[u]), 0.f, 255.f);
                 }
             }
+        }
+    }, progress);
+}
+
+/*
+ * How convolve_color_channels convolves an image: directly, as two 1D
+ * passes when the kernel is separable, or in the frequency domain,
+ * whichever the cost model expects to be the fastest.
+ */
+struct ConvolutionPlan {
+    enum Method { DIRECT, SEPARABLE, FFT };
+
+    Method method = DIRECT;
+    // separable: kernel[i * kernel_size + j] = column[i] * row[j]
+    std::vector<float> column;
+    std::vector<float> row;
+    // FFT: size of the transforms and count of them, the units of its progress
+    int fft_size = 0;
+    int64_t transform_count = 0;
+};
+
+/*
+ * Cost model of the methods, in nanoseconds of one thread per output pixel
+ * of an RGBA image, fitted to timings of each method; gray images take
+ * about a third of the direct and separable costs. The direct and
+ * separable costs are those of the fastest pixel kernels (AVX-512), not of
+ * the running CPU: the FFT rounds differently than the direct methods, so
+ * the plan must not depend on the CPU for every level to give the same
+ * output, and the FFT is only taken where it is faster than any direct path.
+ */
+constexpr double direct_tap_cost = .28;
+constexpr double separable_tap_cost = .45;
+
+// per value of a transform: forward, product with the spectrum of the kernel and inverse
+static double fft_value_cost(int fft_size) {
+    // the two planes of a transform larger than 256 leave the L2 cache of most CPUs
+    const double cache_factor = fft_size <= 256 ? 1. : (fft_size == 512 ? 1.3 : 2.);
+    return 3.6 * std::log2(fft_size) * cache_factor;
+}
+
+// transforms the costs were fitted on, the largest taking 8 MB for its two planes
+constexpr int min_fft_size = 64;
+constexpr int max_fft_size = 1024;
+
+// FFT transforms of a size over an image of the color channels
+static int64_t count_fft_transforms(int width, int height, int color_channels, int kernel_size, int fft_size) {
+    const int tile_size = fft_size - kernel_size + 1;
+    const int64_t tile_count_x = (width + tile_size - 1) / tile_size;
+    const int64_t tile_count_y = (height + tile_size - 1) / tile_size;
+    return tile_count_y * ((tile_count_x * color_channels + 1) / 2);
+}
+
+// allow_fft false plans the exact methods only, direct or separable, which don't depend on the image size
+static ConvolutionPlan plan_convolution(int channels, int width, int height, int kernel_size, const float *kernel,
+        bool allow_fft=true) {
+    ConvolutionPlan plan;
+    const double pixel_count = std::max((double) width * height, 1.);
+    const double channel_factor = channels == 4 ? 1. : .3;
+    double cost = direct_tap_cost * channel_factor * kernel_size * kernel_size;
+
+    // a rank-1 kernel runs as two 1D passes, O(2K) instead of O(K^2) per pixel
+    plan.column.resize(kernel_size);
+    plan.row.resize(kernel_size);
+    if (kernel_size >= min_separable_kernel_size
+            && factor_separable_kernel(kernel_size, kernel, plan.column.data(), plan.row.data())) {
+        plan.method = ConvolutionPlan::SEPARABLE;
+        cost = separable_tap_cost * channel_factor * 2 * kernel_size;
+    }
+    if (!allow_fft)
+        return plan;
+
+    // transforms from the smallest leaving two outputs a side per tile to the smallest covering the image
+    const int color_channels = channels == 4 ? 3 : channels;
+    const int largest_size = std::min(max_fft_size, fft_size_at_least(std::max(width, height) + kernel_size - 1));
+    for (int n = std::max(min_fft_size, fft_size_at_least(kernel_size + 1)); n <= largest_size; n *= 2) {
+        const int64_t transform_count = count_fft_transforms(width, height, color_channels, kernel_size, n);
+        const double fft_pixel_cost = transform_count * (double) n * n * fft_value_cost(n) / pixel_count;
+        if (fft_pixel_cost < cost) {
+            plan.method = ConvolutionPlan::FFT;
+            plan.fft_size = n;
+            plan.transform_count = transform_count;
+            cost = fft_pixel_cost;
+        }
+    }
+    return plan;
+}
+
+// plan of the method instead of the fastest one; false when the kernel can't run with it
+static bool plan_convolution_method(int channels, int width, int height, int kernel_size, const float *kernel,
+        ConvolutionMethod method, ConvolutionPlan &plan) {
+    plan = ConvolutionPlan();
+    if (method == ConvolutionMethod::SEPARABLE) {
+        plan.column.resize(kernel_size);
+        plan.row.resize(kernel_size);
+        if (!factor_separable_kernel(kernel_size, kernel, plan.column.data(), plan.row.data()))
+            return false;
+        plan.method = ConvolutionPlan::SEPARABLE;
+    } else if (method == ConvolutionMethod::FFT) {
+        // the smallest transform leaving two outputs a side per tile
+        const int fft_size = std::max(min_fft_size, fft_size_at_least(kernel_size + 1));
+        if (fft_size > max_fft_size)
+            return false;
+        plan.method = ConvolutionPlan::FFT;
+        plan.fft_size = fft_size;
+        plan.transform_count = count_fft_transforms(width, height, channels == 4 ? 3 : channels, kernel_size, fft_size);
+    }
+    return true;
+}
+
+bool convolution_uses_fft(int width, int height, int kernel_size, const float *kernel) {
+    return plan_convolution(4, width, height, kernel_size, kernel).method == ConvolutionPlan::FFT;
+}
+
+// units of progress of convolve_color_channels
+static int64_t convolution_progress_units(const ConvolutionPlan &plan, int height) {
+    return plan.method == ConvolutionPlan::FFT ? plan.transform_count : height;
+}
+
+// direct convolution of count pixels of a row, their taps at rows[i]
+template <int C>
+static void convolve_pixels(const PixelKernels &kernels, const uint8_t *const *rows, int kernel_size,
+        const float *weights, const uint8_t *in_pixels, uint8_t *out_pixels, int count) {
+    if constexpr (C == 4) {
+        // preserve original alpha channel
+        kernels.convolve_row(rows, kernel_size, weights, in_pixels, out_pixels, count);
+    } else {
+        kernels.convolve_gray_row(rows, kernel_size, weights, out_pixels, count);
+    }
+}
+
+// convolution of the color channels (the first 3 of RGBA or the only channel of gray); alpha is preserved
+template <int C>
+static void convolve_color_channels(BasicImageView<const uint8_t, C> image, BasicImageView<uint8_t, C> out_image,
+        const ConvolutionPlan &plan, int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method, Progress *progress) {
+    ScratchScope scratch;
+    const ConvolutionEdges edges(scratch.arena(), image.getImageWidth(), image.getImageHeight(), kernel_size,
+            edge_handling_method);
+
+    if (plan.method == ConvolutionPlan::SEPARABLE) {
+        convolve_separable<C>(image, out_image, edges, kernel_size, plan.column.data(), plan.row.data(), progress);
+        return;
+    }
+    if (plan.method == ConvolutionPlan::FFT) {
+        if constexpr (C == 4) {
+            // the transforms read the color channels as planes, all taken before any output is written
+            ConstGray8View planes[3];
+            Gray8View color_planes[3];
+            for (int c = 0; c < 3; ++c) {
+                color_planes[c] = scratch.arena().allocateImage<uint8_t, 1>(image.getImageWidth(), image.getImageHeight());
+                planes[c] = color_planes[c];
+            }
+            deinterleave(image, color_planes, 3);
+            convolve_fft<4>(planes, 3, &out_image, edges, kernel_size, kernel, plan.fft_size, progress);
 
-            // copy the right pixel from the original image
-            padded_image->pixel(padded_x, padded_y)[Image::R] = image->pixel(map_x, map_y)[Image::R];
-            padded_image->pixel(padded_x, padded_y)[Image::G] = image->pixel(map_x, map_y)[Image::G];
-            padded_image->pixel(padded_x, padded_y)[Image::B] = image->pixel(map_x, map_y)[Image::B];
+            // preserve original alpha channel
+            if (out_image.data() != image.data()) {
+                parallel_for_rows(image.getImageWidth(), image.getImageHeight(), [&](int y_begin, int y_end) {
+                    for (int y = y_begin; y < y_end; ++y) {
+                        for (int x = 0; x < image.getImageWidth(); ++x)
+                            out_image.pixel(x, y)[Image::A] = image.pixel(x, y)[Image::A];
+                    }
+                });
+            }
+        } else {
+            convolve_fft<1>(&image, 1, &out_image, edges, kernel_size, kernel, plan.fft_size, progress);
         }
+        return;
     }
 
-    // make result image
-    std::shared_ptr<Image> result = std::make_shared<Image>(image->getImageWidth(), image->getImageHeight());
-
-    // do convolution on each pixel
-    for (int y = 0; y < image->getImageHeight(); ++y) {
-        const int padded_y = y + kernel_size - 1;
-        for (int x = 0; x < image->getImageWidth(); ++x) {
-            const int padded_x = x + kernel_size - 1;
-
-            float sum[3] = {};
-            for (int t = -half_kernel_size; t <= half_kernel_size; ++t) {
-                for (int s = -half_kernel_size; s <= half_kernel_size; ++s) {
-                    const int kernel_index = (half_kernel_size - t) * kernel_size + (half_kernel_size - s);
-                    sum[Image::R] += kernel[kernel_index] * padded_image->pixel(padded_x + s, padded_y + t)[Image::R];
-                    sum[Image::G] += kernel[kernel_index] * padded_image->pixel(padded_x + s, padded_y + t)[Image::G];
-                    sum[Image::B] += kernel[kernel_index] * padded_image->pixel(padded_x + s, padded_y + t)[Image::B];
+    // the weights in the order of the taps, the kernel flipped
+    float *weights = scratch.arena().allocate<float>(kernel_size * kernel_size);
+    std::reverse_copy(kernel, kernel + kernel_size * kernel_size, weights);
+    const PixelKernels &kernels = get_pixel_kernels();
+    const int half_kernel_size = edges.half_kernel_size;
+
+    // do convolution on each pixel, in bands of rows
+    parallel_for_rows(image.getImageWidth(), image.getImageHeight(), [&](int y_begin, int y_end) {
+        ScratchScope band_scratch;
+        const uint8_t **rows = band_scratch.arena().allocate<const uint8_t *>(kernel_size);
+        const uint8_t **tap_rows = band_scratch.arena().allocate<const uint8_t *>(kernel_size);
+        const int taps_size = 3 * half_kernel_size * C;
+        uint8_t *taps = band_scratch.arena().allocate<uint8_t>((std::size_t) kernel_size * taps_size);
+
+        for (int y = y_begin; y < y_end; ++y) {
+            // taps of the first interior pixel start at (interior_begin - half_kernel_size, y - half_kernel_size)
+            if (edges.interior_begin < edges.interior_end) {
+                for (int i = 0; i < kernel_size; ++i)
+                    rows[i] = image.row(edges.rows[y + i]) + (edges.interior_begin - half_kernel_size) * C;
+                convolve_pixels<C>(kernels, rows, kernel_size, weights, image.row(y) + edges.interior_begin * C,
+                        out_image.row(y) + edges.interior_begin * C, edges.interior_end - edges.interior_begin);
+            }
+
+            // pixels near the edges
+            for (const auto &[x_begin, x_end] : edges.border_ranges) {
+                if (x_begin == x_end)
+                    continue;
+                for (int i = 0; i < kernel_size; ++i) {
+                    edges.gatherTaps<C>(image.row(edges.rows[y + i]), x_begin, x_end, taps + i * taps_size);
+                    tap_rows[i] = taps + i * taps_size;
                 }
+                convolve_pixels<C>(kernels, tap_rows, kernel_size, weights, image.row(y) + x_begin * C,
+                        out_image.row(y) + x_begin * C, x_end - x_begin);
             }
+        }
+    }, progress);
+}
+
+void image_convolution(ConstImageView image, ImageView out_image, int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method, Progress *progress) {
+    const ConvolutionPlan plan = plan_convolution(4, image.getImageWidth(), image.getImageHeight(), kernel_size, kernel);
+    add_progress_total(progress, convolution_progress_units(plan, image.getImageHeight()));
+    convolve_color_channels<4>(image, out_image, plan, kernel_size, kernel, edge_handling_method, progress);
+}
+
+bool image_convolution(ConstImageView image, ImageView out_image, int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method, ConvolutionMethod method, Progress *progress) {
+    ConvolutionPlan plan;
+    if (!plan_convolution_method(4, image.getImageWidth(), image.getImageHeight(), kernel_size, kernel, method, plan))
+        return false;
+    add_progress_total(progress, convolution_progress_units(plan, image.getImageHeight()));
+    convolve_color_channels<4>(image, out_image, plan, kernel_size, kernel, edge_handling_method, progress);
+    return true;
+}
+
+void image_convolution(ConstGray8View image, Gray8View out_image, int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method, Progress *progress) {
+    const ConvolutionPlan plan = plan_convolution(1, image.getImageWidth(), image.getImageHeight(), kernel_size, kernel);
+    add_progress_total(progress, convolution_progress_units(plan, image.getImageHeight()));
+    convolve_color_channels<1>(image, out_image, plan, kernel_size, kernel, edge_handling_method, progress);
+}
+
+void image_convolution(const PlanarRGBA8Image &image, PlanarRGBA8Image &out_image, int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method, Progress *progress) {
+    // the plan of the interleaved image, whose output it gives
+    const int width = image.getImageWidth();
+    const int height = image.getImageHeight();
+    const ConvolutionPlan plan = plan_convolution(4, width, height, kernel_size, kernel);
+    const bool is_fft = plan.method == ConvolutionPlan::FFT;
+    add_progress_total(progress, (is_fft ? 1 : 3) * convolution_progress_units(plan, height));
+
+    // each output pixel reads its neighbors, so in place the color planes are convolved from a copy
+    ScratchScope scratch;
+    ConstGray8View planes[3];
+    for (int c = 0; c < 3; ++c) {
+        planes[c] = image.plane(c);
+        if (&out_image == &image) {
+            const Gray8View copy = scratch.arena().allocateImage<uint8_t, 1>(width, height);
+            copy_pixels(planes[c], copy);
+            planes[c] = copy;
+        }
+    }
+    prepare_output(image, out_image);
+    if (&out_image != &image)
+        copy_pixels(image.plane(Image::A), out_image.plane(Image::A));  // preserve original alpha channel
+
+    const Gray8View out_planes[3] = {out_image.plane(Image::R), out_image.plane(Image::G), out_image.plane(Image::B)};
+    if (is_fft) {
+        // all planes through the same transforms as the interleaved image
+        const ConvolutionEdges edges(scratch.arena(), width, height, kernel_size, edge_handling_method);
+        convolve_fft<1>(planes, 3, out_planes, edges, kernel_size, kernel, plan.fft_size, progress);
+        return;
+    }
+    for (int c = 0; c < 3; ++c)
+        convolve_color_channels<1>(planes[c], out_planes[c], plan, kernel_size, kernel, edge_handling_method, progress);
+}
+
+// read a region which may extend past the image borders, filling the outside with edge handling
+static void read_region_with_edges(const TiledImage &image, int64_t x, int64_t y, ImageView out_region,
+        ConvolutionEdgeHandlingMethod edge_handling_method) {
+    const int64_t inside_x_begin = clamp<int64_t>(x, 0, image.getImageWidth());
+    const int64_t inside_x_end = clamp<int64_t>(x + out_region.getImageWidth(), 0, image.getImageWidth());
+    const int inside_width = (int) std::max<int64_t>(inside_x_end - inside_x_begin, 0);
+
+    for (int region_y = 0; region_y < out_region.getImageHeight(); ++region_y) {
+        const int64_t map_y = map_edge_coordinate(y + region_y, image.getImageHeight(), edge_handling_method);
+        const ImageView out_row = out_region.subview(0, region_y, out_region.getImageWidth(), 1);
 
-            result->pixel(x, y)[Image::R] = clamp(round(sum[Image::R]), 0.0, 255.0);
-            result->pixel(x, y)[Image::G] = clamp(round(sum[Image::G]), 0.0, 255.0);
-            result->pixel(x, y)[Image::B] = clamp(round(sum[Image::B]), 0.0, 255.0);
-            result->pixel(x, y)[Image::A] = image->pixel(x, y)[Image::A];  // preserve original alpha channel
+        // the part inside the image is copied tile by tile, the rest pixel by pixel
+        image.readRegion(inside_x_begin, map_y, out_row.subview((int) (inside_x_begin - x), 0, inside_width, 1));
+        for (int region_x = 0; region_x < out_region.getImageWidth(); ++region_x) {
+            const int64_t image_x = x + region_x;
+            if (image_x >= inside_x_begin && image_x < inside_x_end)
+                continue;
+            const int64_t map_x = map_edge_coordinate(image_x, image.getImageWidth(), edge_handling_method);
+            memcpy(out_row.pixel(region_x, 0), image.pixel(map_x, map_y), 4);
         }
     }
+}
+
+void image_convolution(const TiledImage &image, TiledImage &out_image, int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method, Progress *progress) {
+    const int half_kernel_size = kernel_size / 2;
+    add_progress_total(progress, image.getTileCountX() * image.getTileCountY());
+    out_image.init(image.getImageWidth(), image.getImageHeight(), Image::INIT_UNINITIALIZED);
+    // one plan for all tiles, of an exact method, so tiles don't depend on their size or position
+    const ConvolutionPlan plan = plan_convolution(4, 0, 0, kernel_size, kernel, false);
 
-    result->loadToTexture();
-    return result;
+    // convolve each tile together with the halo of source pixels around it
+    out_image.parallelForEachTile([&](ImageView out_tile, int64_t tile_x, int64_t tile_y) {
+        ScratchScope scratch;
+        const ImageView tile_with_halo = scratch.arena().allocateImage<uint8_t, 4>(
+                out_tile.getImageWidth() + 2 * half_kernel_size, out_tile.getImageHeight() + 2 * half_kernel_size);
+        read_region_with_edges(image, tile_x - half_kernel_size, tile_y - half_kernel_size, tile_with_halo,
+                edge_handling_method);
+        const ImageView tile_result = scratch.arena().allocateImage<uint8_t, 4>(
+                tile_with_halo.getImageWidth(), tile_with_halo.getImageHeight());
+        convolve_color_channels<4>(ConstImageView(tile_with_halo), tile_result, plan, kernel_size, kernel,
+                edge_handling_method, nullptr);
+        copy_pixels(ConstImageView(tile_result.subview(half_kernel_size, half_kernel_size,
+                out_tile.getImageWidth(), out_tile.getImageHeight())), out_tile);
+    }, progress);
+}
+
+std::shared_ptr<Image> image_convolution(const std::shared_ptr<Image> image, int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method, Progress *progress) {
+    std::shared_ptr<Image> result = std::make_shared<Image>(
+            image->getImageWidth(), image->getImageHeight(), Image::INIT_UNINITIALIZED);
+    image_convolution(std::as_const(*image).view(), result->view(), kernel_size, kernel, edge_handling_method, progress);
+    return is_canceled(progress) ? nullptr : result;
 }
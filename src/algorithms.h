@@ -5,6 +5,11 @@
 #include <memory>
 
 #include "image.h"
+#include "image_view.h"
+#include "planar_image.h"
+#include "progress.h"
+#include "tiled_image.h"
+#include "typed_image.h"
 
 enum class ConvolutionEdgeHandlingMethod {
     EXTEND = 0,
@@ -12,14 +17,94 @@ enum class ConvolutionEdgeHandlingMethod {
     MIRROR
 };
 
+// methods of the convolution, image_convolution picks the fastest one for the kernel and image size
+enum class ConvolutionMethod {
+    DIRECT = 0,
+    SEPARABLE,  // rank-1 kernels only
+    FFT         // kernels smaller than the largest transform only
+};
+
+/*
+ * The view overloads work on any region of an image without copying it.
+ * The output view must have the same size as the input view; an empty
+ * output view of generate_gray_image_and_histogram computes the histogram only.
+ * Gray8/Gray32F overloads work on single channel images (one value per
+ * pixel), the Gray32F ones without rounding or clamping. Planar overloads
+ * work on the planes of a PlanarRGBA8Image and give the same pixels as the
+ * interleaved overloads; out_image may be image, and is (re)initialized to
+ * the input size otherwise.
+ *
+ * Point operations (gray conversion, noise, lookup table, histogram
+ * equalization) also accept the input itself as output and then work in
+ * place. Their shared_ptr overloads taking an out_image work in place when
+ * out_image is image, and (re)initialize out_image to the input size otherwise.
+ *
+ * Convolutions of large kernels run in the frequency domain when that is
+ * faster, within 1 level of the exact result; the choice depends on the
+ * kernel and the image size only, never on the CPU. The TiledImage
+ * convolution always runs the exact direct or separable methods.
+ *
+ * Long running operations take an optional progress, which they report to
+ * and stop early on once it is canceled. Canceled operations leave their
+ * output incomplete, the ones returning a new image return nullptr.
+ */
+
 uint8_t to_gray_average(const uint8_t *pixel);
-void generate_gray_image_and_histogram(const std::shared_ptr<Image> image, std::shared_ptr<Image> out_image, float *histogram);
+void generate_gray_image_and_histogram(ConstImageView image, ImageView out_image, float *histogram, Progress *progress=nullptr);
+void generate_gray_image_and_histogram(ConstImageView image, Gray8View out_image, float *histogram, Progress *progress=nullptr);
+void generate_gray_image_and_histogram(const std::shared_ptr<Image> image, std::shared_ptr<Image> out_image, float *histogram,
+        Progress *progress=nullptr);
+void convert_to_gray(ConstImageView image, ImageView out_image);
+void convert_to_gray(const std::shared_ptr<Image> image, std::shared_ptr<Image> out_image);
+void convert_to_gray(const TiledImage &image, TiledImage &out_image);
 std::shared_ptr<Image> generate_histogram_image(const float *histogram);
-void generate_gaussian_noise(float *out_noise, int count, float sigma);
-void generate_histogram_from_array(const float *noise, int count, float *histogram);
-std::shared_ptr<Image> haar_wavelet_transform(const std::shared_ptr<Image> image, int level, float scale=1.f);
-std::shared_ptr<Image> histogram_equalization(const std::shared_ptr<Image> image);
+// noise of the same seed is the same whatever the number of threads
+void generate_gaussian_noise(float *out_noise, int64_t count, float sigma, uint64_t seed=0, Progress *progress=nullptr);
+// values [begin, end) of the noise of the seed
+void generate_gaussian_noise_range(float *out_noise, int64_t begin, int64_t end, float sigma, uint64_t seed=0);
+void add_noise(ConstImageView image, ImageView out_image, const float *noise, Progress *progress=nullptr);
+void add_noise(const PlanarRGBA8Image &image, PlanarRGBA8Image &out_image, const float *noise, Progress *progress=nullptr);
+void add_noise(const std::shared_ptr<Image> image, std::shared_ptr<Image> out_image, const float *noise,
+        Progress *progress=nullptr);
+void apply_lookup_table(ConstImageView image, ImageView out_image, const uint8_t *lut);
+void apply_lookup_table(const std::shared_ptr<Image> image, std::shared_ptr<Image> out_image, const uint8_t *lut);
+void apply_lookup_table(const TiledImage &image, TiledImage &out_image, const uint8_t *lut);
+// histogram of the values plus offset, clamped to [0, 1]
+void generate_histogram_from_array(const float *noise, int64_t count, float *histogram, float offset=0.f);
+void haar_wavelet_transform(ConstGray8View image, Gray8View out_image, int level, float scale=1.f, Progress *progress=nullptr);
+void haar_wavelet_transform(ConstGray32FView image, Gray32FView out_image, int level, float scale=1.f,
+        Progress *progress=nullptr);
+// RGBA and planar: the red channel is transformed into the red, green and blue channels, alpha is kept
+void haar_wavelet_transform(ConstImageView image, ImageView out_image, int level, float scale=1.f, Progress *progress=nullptr);
+void haar_wavelet_transform(const PlanarRGBA8Image &image, PlanarRGBA8Image &out_image, int level, float scale=1.f,
+        Progress *progress=nullptr);
+std::shared_ptr<Image> haar_wavelet_transform(const std::shared_ptr<Image> image, int level, float scale=1.f,
+        Progress *progress=nullptr);
+// transform of the gray image resized to the nearest powers of 2, as an opaque RGBA image; nullptr when canceled
+std::shared_ptr<Image> gray_haar_wavelet_transform(const std::shared_ptr<Image> image, int level, float scale=1.f,
+        Progress *progress=nullptr);
+// map of histogram equalization from the red channel histogram, which is turned into the cumulative histogram
+void compute_equalization_map(int64_t *histogram, uint8_t *transform_map);
+void histogram_equalization(ConstImageView image, ImageView out_image, Progress *progress=nullptr);
+std::shared_ptr<Image> histogram_equalization(const std::shared_ptr<Image> image, Progress *progress=nullptr);
+void histogram_equalization(const std::shared_ptr<Image> image, std::shared_ptr<Image> out_image, Progress *progress=nullptr);
+void histogram_equalization(const TiledImage &image, TiledImage &out_image, Progress *progress=nullptr);
+// coordinate inside [0, size) read for a coordinate outside of the image
+int64_t map_edge_coordinate(int64_t coordinate, int64_t size, ConvolutionEdgeHandlingMethod edge_handling_method);
+// whether image_convolution of an RGBA image of the size runs the kernel in the frequency domain
+bool convolution_uses_fft(int width, int height, int kernel_size, const float *kernel);
+void image_convolution(ConstImageView image, ImageView out_image, int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method=ConvolutionEdgeHandlingMethod::EXTEND, Progress *progress=nullptr);
+// with the method instead of the fastest one, to compare the methods; false when the kernel can't run with it
+bool image_convolution(ConstImageView image, ImageView out_image, int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method, ConvolutionMethod method, Progress *progress=nullptr);
+void image_convolution(ConstGray8View image, Gray8View out_image, int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method=ConvolutionEdgeHandlingMethod::EXTEND, Progress *progress=nullptr);
+void image_convolution(const PlanarRGBA8Image &image, PlanarRGBA8Image &out_image, int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method=ConvolutionEdgeHandlingMethod::EXTEND, Progress *progress=nullptr);
+void image_convolution(const TiledImage &image, TiledImage &out_image, int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method=ConvolutionEdgeHandlingMethod::EXTEND, Progress *progress=nullptr);
 std::shared_ptr<Image> image_convolution(const std::shared_ptr<Image> image, int kernel_size, const float *kernel,
-        ConvolutionEdgeHandlingMethod edge_handling_method=ConvolutionEdgeHandlingMethod::EXTEND);
+        ConvolutionEdgeHandlingMethod edge_handling_method=ConvolutionEdgeHandlingMethod::EXTEND, Progress *progress=nullptr);
 
 #endif // ADVANCED_IMAGE_PROCESSOR_ALGORITHMS_H__
@@ -0,0 +1,462 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "algorithms.h"
+#include "image.h"
+#include "lazy_image.h"
+
+// image on its way through the stages, with the file it came from and the file it goes to
+struct BatchItem {
+    std::string input_path;
+    std::string output_path;
+    std::shared_ptr<Image> image;
+};
+
+/*
+ * Queue between two stages of the batch. Producers wait while it is full,
+ * so a fast stage can't run ahead of a slow one by more than the capacity,
+ * and consumers wait while it is empty. Once every producer finished and
+ * the queue is drained, pop() returns false.
+ */
+class BatchQueue {
+public:
+
+    BatchQueue(int capacity, int producer_count) : _capacity(capacity), _producer_count(producer_count) {}
+
+    void push(BatchItem item) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_full.wait(lock, [&] { return (int) _items.size() < _capacity; });
+        _items.push_back(std::move(item));
+        _not_empty.notify_one();
+    }
+
+    bool pop(BatchItem &item) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _not_empty.wait(lock, [&] { return !_items.empty() || _producer_count == 0; });
+        if (_items.empty())
+            return false;
+        item = std::move(_items.front());
+        _items.pop_front();
+        _not_full.notify_one();
+        return true;
+    }
+
+    void finishProducer() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_producer_count == 0)
+            _not_empty.notify_all();
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _not_full;
+    std::condition_variable _not_empty;
+    std::deque<BatchItem> _items;
+    int _capacity;
+    int _producer_count;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// result of the operations; nullptr if one failed
+static std::shared_ptr<Image> apply_operations(const BatchOptions &options, std::shared_ptr<Image> image) {
+    // operations are recorded on a lazy image, until haar or resize need the pixels
+    LazyImage pending(image);
+    bool has_pending = false;
+    std::size_t kernel_index = 0;
+    for (BatchOptions::Operation operation : options.operations) {
+        switch (operation) {
+        case BatchOptions::GRAY:
+            pending = pending.gray();
+            has_pending = true;
+            continue;
+        case BatchOptions::HISTOGRAM_EQUALIZATION:
+            pending = pending.histogramEqualization();
+            has_pending = true;
+            continue;
+        case BatchOptions::CONVOLUTION: {
+            const BatchOptions::Kernel &kernel = options.kernels[kernel_index++];
+            pending = pending.convolution(kernel.size, kernel.weights.data(), options.edge_handling_method);
+            has_pending = true;
+            continue;
+        }
+        case BatchOptions::GAUSSIAN_NOISE:
+            // same noise as the Gaussian noise menu
+            pending = pending.noise(options.sigma / 255.f, options.seed);
+            has_pending = true;
+            continue;
+        default:
+            break;
+        }
+
+        if (has_pending && (image = pending.evaluate()) == nullptr)
+            return nullptr;
+        if (operation == BatchOptions::HAAR_WAVELET)
+            image = gray_haar_wavelet_transform(image, options.level, options.scale);
+        else if (!image->resize(options.width, options.height))
+            image = nullptr;
+        if (image == nullptr)
+            return nullptr;
+        pending = LazyImage(image);
+        has_pending = false;
+    }
+    return has_pending ? pending.evaluate() : image;
+}
+
+// file name of the input in the output directory, JPG inputs stay JPG and everything else becomes PNG
+static std::string get_output_path(const std::string &output_directory, const std::string &input_path) {
+    std::filesystem::path output_path = std::filesystem::path(output_directory) / std::filesystem::path(input_path).filename();
+    if (output_path.extension() != ".jpg")
+        output_path.replace_extension(".png");
+    return output_path.string();
+}
+
+BatchReport run_batch(const BatchOptions &options) {
+    BatchReport report;
+    std::mutex report_mutex;
+    const auto start = std::chrono::steady_clock::now();
+
+    const int io_threads = std::max(options.io_threads, 1);
+    BatchQueue decoded(std::max(options.queue_depth, 1), io_threads);
+    BatchQueue processed(std::max(options.queue_depth, 1), 1);
+
+    auto fail = [&](const std::string &message, const std::string &path) {
+        std::lock_guard<std::mutex> lock(report_mutex);
+        std::cerr << "Error: " << message << " \"" << path << "\" failed!" << std::endl;
+        ++report.failed;
+    };
+
+    // an input saved to the same file as an earlier one (same name in another directory or with another extension)
+    // fails, rather than the two overwriting each other
+    std::vector<std::string> output_paths;
+    std::vector<std::size_t> inputs;
+    std::set<std::string> taken_output_paths;
+    for (std::size_t index = 0; index < options.input_paths.size(); ++index) {
+        const std::string output_path = get_output_path(options.output_directory, options.input_paths[index]);
+        output_paths.push_back(output_path);
+        if (taken_output_paths.insert(output_path).second)
+            inputs.push_back(index);
+        else
+            fail("Output file \"" + output_path + "\" already used, image", options.input_paths[index]);
+    }
+
+    // decode: the next input not taken yet by another thread
+    std::atomic<std::size_t> next_input = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < io_threads; ++i) {
+        threads.emplace_back([&] {
+            std::size_t next;
+            while ((next = next_input++) < inputs.size()) {
+                const std::size_t index = inputs[next];
+                const std::string &path = options.input_paths[index];
+                const auto decode_start = std::chrono::steady_clock::now();
+                std::shared_ptr<Image> image = std::make_shared<Image>();
+                const bool loaded = image->loadFromFile(path);
+                {
+                    std::lock_guard<std::mutex> lock(report_mutex);
+                    report.decode_seconds += seconds_since(decode_start);
+                }
+                if (!loaded) {
+                    fail("Open image", path);
+                    continue;
+                }
+                decoded.push({path, output_paths[index], std::move(image)});
+            }
+            decoded.finishProducer();
+        });
+    }
+
+    // encode
+    for (int i = 0; i < io_threads; ++i) {
+        threads.emplace_back([&] {
+            BatchItem item;
+            while (processed.pop(item)) {
+                const std::string &output_path = item.output_path;
+                const auto encode_start = std::chrono::steady_clock::now();
+                const bool saved = item.image->saveToFile(output_path);
+                item.image.reset();
+                {
+                    std::lock_guard<std::mutex> lock(report_mutex);
+                    report.encode_seconds += seconds_since(encode_start);
+                    if (saved)
+                        ++report.processed;
+                }
+                if (!saved)
+                    fail("Save image", output_path);
+            }
+        });
+    }
+
+    // process on this thread, each image spread over the thread pool
+    BatchItem item;
+    while (decoded.pop(item)) {
+        const auto process_start = std::chrono::steady_clock::now();
+        std::shared_ptr<Image> result = apply_operations(options, std::move(item.image));
+        {
+            std::lock_guard<std::mutex> lock(report_mutex);
+            report.process_seconds += seconds_since(process_start);
+        }
+        if (result == nullptr) {
+            fail("Process image", item.input_path);
+            continue;
+        }
+        processed.push({item.input_path, item.output_path, std::move(result)});
+    }
+    processed.finishProducer();
+
+    for (std::thread &thread : threads)
+        thread.join();
+
+    report.seconds = seconds_since(start);
+    return report;
+}
+
+bool load_kernel(const std::string &filepath, int &kernel_size, std::vector<float> &kernel) {
+    std::ifstream file(filepath);
+    if (!file)
+        return false;
+
+    std::vector<float> weights;
+    std::string token;
+    while (file >> token) {
+        // commas separate weights as well as white space
+        for (char &c : token) {
+            if (c == ',')
+                c = ' ';
+        }
+        const char *begin = token.c_str();
+        char *end = nullptr;
+        while (true) {
+            const float weight = std::strtof(begin, &end);
+            if (end == begin)
+                break;
+            weights.push_back(weight);
+            begin = end;
+        }
+        // anything else than numbers
+        while (*begin == ' ')
+            ++begin;
+        if (*begin != '\0')
+            return false;
+    }
+
+    int size = 1;
+    while (size * size < (int) weights.size())
+        size += 2;
+    if (weights.empty() || size * size != (int) weights.size())
+        return false;
+
+    kernel_size = size;
+    kernel = std::move(weights);
+    return true;
+}
+
+// limits of the options, beyond which an operation does nothing more or can't allocate its result
+static constexpr int max_level = 30;            // images of up to 2^30 pixels per side are halved down to one pixel
+static constexpr int max_image_size = 65536;    // width and height of a resize
+static constexpr int max_kernel_size = 1023;
+
+static bool parse_int(const char *text, int &value, int min=INT_MIN, int max=INT_MAX) {
+    char *end = nullptr;
+    errno = 0;
+    const long long parsed = std::strtoll(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < min || parsed > max)
+        return false;
+    value = (int) parsed;
+    return true;
+}
+
+static bool parse_float(const char *text, float &value) {
+    char *end = nullptr;
+    errno = 0;
+    const float parsed = std::strtof(text, &end);
+    if (end == text || *end != '\0' || errno == ERANGE)
+        return false;
+    value = parsed;
+    return true;
+}
+
+static bool parse_uint64(const char *text, uint64_t &value) {
+    char *end = nullptr;
+    const unsigned long long parsed = std::strtoull(text, &end, 10);
+    if (end == text || *end != '\0')
+        return false;
+    value = parsed;
+    return true;
+}
+
+static void print_batch_usage() {
+    std::cerr <<
+        "Usage: batch --op OPERATION [--op OPERATION]... [options] INPUT... -o OUTPUT_DIRECTORY\n"
+        "\n"
+        "Operations, run in order, the n-th convolution with the n-th --kernel:\n"
+        "  gray                      gray scale\n"
+        "  histogram-equalization    histogram equalization\n"
+        "  convolution               convolution with --kernel FILE [--edge extend|wrap|mirror]\n"
+        "  haar                      haar wavelet transform of the gray image resized to powers of 2\n"
+        "                            [--level N] [--scale S]\n"
+        "  resize                    resize to --width W --height H\n"
+        "  noise                     gaussian noise [--sigma S] [--seed N]\n"
+        "\n"
+        "Options:\n"
+        "  --io-threads N            threads decoding and threads encoding (default 2)\n"
+        "  --queue N                 images waiting between two stages (default 4)\n";
+}
+
+int run_batch_command(int argc, const char **argv) {
+    BatchOptions options;
+    std::vector<std::string> kernel_paths;
+
+    for (int i = 0; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        const char *value = has_value ? argv[i + 1] : "";
+        bool valid = has_value;
+        std::string expected;  // values the option takes, for the error
+
+        if (arg == "-h" || arg == "--help") {
+            print_batch_usage();
+            return 0;
+        } else if (arg == "--op") {
+            const std::string name = value;
+            if (name == "gray")
+                options.operations.push_back(BatchOptions::GRAY);
+            else if (name == "histogram-equalization")
+                options.operations.push_back(BatchOptions::HISTOGRAM_EQUALIZATION);
+            else if (name == "convolution")
+                options.operations.push_back(BatchOptions::CONVOLUTION);
+            else if (name == "haar")
+                options.operations.push_back(BatchOptions::HAAR_WAVELET);
+            else if (name == "resize")
+                options.operations.push_back(BatchOptions::RESIZE);
+            else if (name == "noise")
+                options.operations.push_back(BatchOptions::GAUSSIAN_NOISE);
+            else
+                valid = false;
+        } else if (arg == "--kernel") {
+            kernel_paths.push_back(value);
+        } else if (arg == "--edge") {
+            const std::string name = value;
+            if (name == "extend")
+                options.edge_handling_method = ConvolutionEdgeHandlingMethod::EXTEND;
+            else if (name == "wrap")
+                options.edge_handling_method = ConvolutionEdgeHandlingMethod::WRAP;
+            else if (name == "mirror")
+                options.edge_handling_method = ConvolutionEdgeHandlingMethod::MIRROR;
+            else
+                valid = false;
+        } else if (arg == "--level") {
+            valid = valid && parse_int(value, options.level, 0, max_level);
+            expected = "an integer from 0 to " + std::to_string(max_level);
+        } else if (arg == "--scale") {
+            valid = valid && parse_float(value, options.scale) && options.scale > 0.f;
+            expected = "a number > 0";
+        } else if (arg == "--width") {
+            valid = valid && parse_int(value, options.width, 1, max_image_size);
+            expected = "an integer from 1 to " + std::to_string(max_image_size);
+        } else if (arg == "--height") {
+            valid = valid && parse_int(value, options.height, 1, max_image_size);
+            expected = "an integer from 1 to " + std::to_string(max_image_size);
+        } else if (arg == "--sigma") {
+            valid = valid && parse_int(value, options.sigma, 0);
+            expected = "an integer >= 0";
+        } else if (arg == "--seed") {
+            valid = valid && parse_uint64(value, options.seed);
+        } else if (arg == "--io-threads") {
+            valid = valid && parse_int(value, options.io_threads, 1);
+            expected = "an integer > 0";
+        } else if (arg == "--queue") {
+            valid = valid && parse_int(value, options.queue_depth, 1);
+            expected = "an integer > 0";
+        } else if (arg == "-o" || arg == "--output") {
+            options.output_directory = value;
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Error: Unknown option \"" << arg << "\"!" << std::endl;
+            print_batch_usage();
+            return 2;
+        } else {
+            options.input_paths.push_back(arg);
+            continue;
+        }
+
+        if (!valid) {
+            std::cerr << "Error: Invalid value for \"" << arg << "\"";
+            if (!expected.empty())
+                std::cerr << ", must be " << expected;
+            std::cerr << "!" << std::endl;
+            return 2;
+        }
+        ++i;  // skip the value
+    }
+
+    // check the options of the operations
+    if (options.operations.empty() || options.input_paths.empty() || options.output_directory.empty()) {
+        print_batch_usage();
+        return 2;
+    }
+    const auto convolution_count = std::count(options.operations.begin(), options.operations.end(),
+            BatchOptions::CONVOLUTION);
+    if (convolution_count != (std::ptrdiff_t) kernel_paths.size()) {
+        std::cerr << "Error: Each convolution needs one --kernel!" << std::endl;
+        return 2;
+    }
+    for (const std::string &kernel_path : kernel_paths) {
+        BatchOptions::Kernel kernel;
+        if (!load_kernel(kernel_path, kernel.size, kernel.weights)) {
+            std::cerr << "Error: Read kernel \"" << kernel_path << "\" failed!" << std::endl;
+            return 2;
+        }
+        if (kernel.size > max_kernel_size) {
+            std::cerr << "Error: Kernel \"" << kernel_path << "\" is larger than " << max_kernel_size << " x "
+                      << max_kernel_size << "!" << std::endl;
+            return 2;
+        }
+        options.kernels.push_back(std::move(kernel));
+    }
+    const bool has_resize = std::find(options.operations.begin(), options.operations.end(),
+            BatchOptions::RESIZE) != options.operations.end();
+    if (has_resize && (options.width == 0 || options.height == 0)) {
+        std::cerr << "Error: Resize needs --width and --height!" << std::endl;
+        return 2;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(options.output_directory, error);
+    if (error) {
+        std::cerr << "Error: Create directory \"" << options.output_directory << "\" failed!" << std::endl;
+        return 1;
+    }
+
+    const BatchReport report = run_batch(options);
+
+    std::cout << "Processed " << report.processed << " images in " << report.seconds << " s ("
+              << (report.seconds > 0. ? report.processed / report.seconds : 0.) << " images/s)";
+    if (report.failed > 0)
+        std::cout << ", " << report.failed << " failed";
+    std::cout << std::endl;
+    std::cout << "Busy time: decode " << report.decode_seconds << " s, process " << report.process_seconds
+              << " s, encode " << report.encode_seconds << " s" << std::endl;
+    return report.failed > 0 ? 1 : 0;
+}
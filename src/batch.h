@@ -0,0 +1,72 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_BATCH_H__
+#define ADVANCED_IMAGE_PROCESSOR_BATCH_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "algorithms.h"
+
+// operations and parameters applied to every image of a batch
+struct BatchOptions {
+    enum Operation { GRAY, HISTOGRAM_EQUALIZATION, CONVOLUTION, HAAR_WAVELET, RESIZE, GAUSSIAN_NOISE };
+
+    // square kernel of size x size weights
+    struct Kernel {
+        int size = 0;
+        std::vector<float> weights;
+    };
+
+    // run in order on each image
+    std::vector<Operation> operations;
+    std::vector<std::string> input_paths;
+    std::string output_directory;
+
+    // convolution, the n-th convolution with the n-th kernel
+    std::vector<Kernel> kernels;
+    ConvolutionEdgeHandlingMethod edge_handling_method = ConvolutionEdgeHandlingMethod::EXTEND;
+    // haar wavelet transform
+    int level = 1;
+    float scale = 1.f;
+    // resize
+    int width = 0;
+    int height = 0;
+    // gaussian noise
+    int sigma = 10;
+    uint64_t seed = 0;
+
+    // threads decoding and threads encoding, and images waiting between two stages
+    int io_threads = 2;
+    int queue_depth = 4;
+};
+
+struct BatchReport {
+    int processed = 0;
+    int failed = 0;
+    double seconds = 0.;
+    // time each stage was busy, summed over its threads
+    double decode_seconds = 0.;
+    double process_seconds = 0.;
+    double encode_seconds = 0.;
+};
+
+/*
+ * Run the operations on every input image and save the results in the
+ * output directory, under the input file name (PNG unless the input is a
+ * JPG). Decoding, processing and encoding run at once on different images,
+ * with at most queue_depth images waiting between two stages; processing
+ * spreads each image over the shared thread pool, and runs consecutive
+ * point and neighborhood operations as one lazy image, chains of
+ * convolutions and histogram equalizations tile by tile. Failed files are
+ * reported on stderr and skipped; an input whose output file is already
+ * the output of an earlier input fails too.
+ */
+BatchReport run_batch(const BatchOptions &options);
+
+// read a kernel of an odd square number of weights, separated by spaces, commas or new lines
+bool load_kernel(const std::string &filepath, int &kernel_size, std::vector<float> &kernel);
+
+// the command line `batch [options] inputs... -o directory`, without the leading "batch"; returns the exit code
+int run_batch_command(int argc, const char **argv);
+
+#endif // ADVANCED_IMAGE_PROCESSOR_BATCH_H__
@@ -0,0 +1,14 @@
+#include <cstring>
+#include <iostream>
+
+#include "batch.h"
+
+// command line tool running the operations without a window: aip batch ...
+int main(int argc, const char **argv) {
+    if (argc >= 2 && std::strcmp(argv[1], "batch") == 0)
+        return run_batch_command(argc - 2, argv + 2);
+
+    std::cerr << "Usage: aip batch --op OPERATION [options] INPUT... -o OUTPUT_DIRECTORY" << std::endl;
+    std::cerr << "Run \"aip batch --help\" for the operations and options." << std::endl;
+    return 2;
+}
@@ -0,0 +1,47 @@
+#include "cpu_features.h"
+
+#include <cstdlib>
+#include <cstring>
+
+CpuLevel detect_cpu_level() {
+#ifdef AIP_X86_KERNELS
+    // also checks that the OS saves the AVX registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return CpuLevel::AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return CpuLevel::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return CpuLevel::SSE2;
+#endif // AIP_X86_KERNELS
+    return CpuLevel::GENERIC;
+}
+
+CpuLevel get_cpu_level() {
+    static const CpuLevel level = [] {
+        CpuLevel detected_level = detect_cpu_level();
+        const char *requested = std::getenv("AIP_CPU_LEVEL");
+        if (requested == nullptr)
+            return detected_level;
+
+        for (int i = (int) CpuLevel::GENERIC; i <= (int) CpuLevel::AVX512; ++i) {
+            if (std::strcmp(requested, cpu_level_name((CpuLevel) i)) == 0 && i < (int) detected_level)
+                return (CpuLevel) i;
+        }
+        return detected_level;
+    }();
+    return level;
+}
+
+const char *cpu_level_name(CpuLevel level) {
+    switch (level) {
+    case CpuLevel::SSE2:
+        return "sse2";
+    case CpuLevel::AVX2:
+        return "avx2";
+    case CpuLevel::AVX512:
+        return "avx512";
+    default:
+        return "generic";
+    }
+}
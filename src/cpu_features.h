@@ -0,0 +1,22 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_CPU_FEATURES_H__
+#define ADVANCED_IMAGE_PROCESSOR_CPU_FEATURES_H__
+
+/*
+ * Instruction set levels the pixel kernels are built for, in increasing
+ * order. GENERIC is portable C++, the others are x86 only and built when
+ * AIP_X86_KERNELS is defined.
+ */
+enum class CpuLevel {
+    GENERIC = 0,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+// highest level the CPU and OS support, from cpuid
+CpuLevel detect_cpu_level();
+// level the kernels use: the detected one, lowered by the AIP_CPU_LEVEL environment variable (generic, sse2, avx2, avx512)
+CpuLevel get_cpu_level();
+const char *cpu_level_name(CpuLevel level);
+
+#endif // ADVANCED_IMAGE_PROCESSOR_CPU_FEATURES_H__
@@ -0,0 +1,98 @@
+#include "fft.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <utility>
+
+SquareFFT::SquareFFT(int size) : _size(size), _bit_reversed(size), _cos(size / 2), _sin(size / 2) {
+    int bits = 0;
+    while ((1 << bits) < size)
+        ++bits;
+    for (int i = 0; i < size; ++i) {
+        int reversed = 0;
+        for (int bit = 0; bit < bits; ++bit) {
+            if (i & (1 << bit))
+                reversed |= 1 << (bits - 1 - bit);
+        }
+        _bit_reversed[i] = reversed;
+    }
+
+    for (int k = 0; k < size / 2; ++k) {
+        const double angle = -2. * std::numbers::pi * k / size;
+        _cos[k] = (float) std::cos(angle);
+        _sin[k] = (float) std::sin(angle);
+    }
+}
+
+void SquareFFT::forward(float *real, float *imaginary) const {
+    transformColumns(real, imaginary, false);
+    transpose_square(real, _size);
+    transpose_square(imaginary, _size);
+    transformColumns(real, imaginary, false);
+}
+
+void SquareFFT::inverse(float *real, float *imaginary) const {
+    transformColumns(real, imaginary, true);
+    transpose_square(real, _size);
+    transpose_square(imaginary, _size);
+    transformColumns(real, imaginary, true);
+}
+
+// radix-2 decimation in time, each butterfly combining two whole rows
+void SquareFFT::transformColumns(float *real, float *imaginary, bool inverse) const {
+    const int n = _size;
+
+    for (int i = 0; i < n; ++i) {
+        const int j = _bit_reversed[i];
+        if (i < j) {
+            std::swap_ranges(real + i * n, real + (i + 1) * n, real + j * n);
+            std::swap_ranges(imaginary + i * n, imaginary + (i + 1) * n, imaginary + j * n);
+        }
+    }
+
+    for (int length = 2; length <= n; length *= 2) {
+        const int half = length / 2;
+        const int twiddle_step = n / length;
+        for (int start = 0; start < n; start += length) {
+            for (int k = 0; k < half; ++k) {
+                const float w_real = _cos[k * twiddle_step];
+                const float w_imaginary = inverse ? -_sin[k * twiddle_step] : _sin[k * twiddle_step];
+                float *a_real = real + (start + k) * n;
+                float *a_imaginary = imaginary + (start + k) * n;
+                float *b_real = real + (start + k + half) * n;
+                float *b_imaginary = imaginary + (start + k + half) * n;
+                for (int c = 0; c < n; ++c) {
+                    const float t_real = b_real[c] * w_real - b_imaginary[c] * w_imaginary;
+                    const float t_imaginary = b_real[c] * w_imaginary + b_imaginary[c] * w_real;
+                    b_real[c] = a_real[c] - t_real;
+                    b_imaginary[c] = a_imaginary[c] - t_imaginary;
+                    a_real[c] += t_real;
+                    a_imaginary[c] += t_imaginary;
+                }
+            }
+        }
+    }
+}
+
+int fft_size_at_least(int value) {
+    int size = 1;
+    while (size < value)
+        size *= 2;
+    return size;
+}
+
+void transpose_square(float *values, int size) {
+    // in blocks, so both the rows and the columns of a block stay in cache
+    constexpr int block_size = 16;
+    for (int block_i = 0; block_i < size; block_i += block_size) {
+        for (int block_j = block_i; block_j < size; block_j += block_size) {
+            const int i_end = std::min(block_i + block_size, size);
+            const int j_end = std::min(block_j + block_size, size);
+            for (int i = block_i; i < i_end; ++i) {
+                for (int j = (block_i == block_j) ? i + 1 : block_j; j < j_end; ++j)
+                    std::swap(values[i * size + j], values[j * size + i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_FFT_H__
+#define ADVANCED_IMAGE_PROCESSOR_FFT_H__
+
+#include <vector>
+
+/*
+ * 2D fast Fourier transform of size x size squares of complex values, for
+ * a power of 2 size, used by the frequency-domain convolution.
+ *
+ * The real and imaginary parts are two planes of packed rows, so the
+ * butterflies of the column transforms work on whole rows of contiguous
+ * floats; the rows are transformed as columns of the transposed square.
+ * The forward transform leaves the spectrum transposed, which is the
+ * layout the inverse transform takes back, so products of two spectra
+ * need no transposition. Transforms are unnormalized: the inverse of the
+ * forward transform is size * size times the input.
+ */
+class SquareFFT {
+public:
+
+    explicit SquareFFT(int size);
+
+    int getSize() const { return _size; }
+
+    void forward(float *real, float *imaginary) const;
+    void inverse(float *real, float *imaginary) const;
+
+private:
+    void transformColumns(float *real, float *imaginary, bool inverse) const;
+
+    int _size;
+    std::vector<int> _bit_reversed;
+    // exp(-2 pi i k / size) for k < size / 2
+    std::vector<float> _cos;
+    std::vector<float> _sin;
+};
+
+// smallest power of 2 not less than value
+int fft_size_at_least(int value);
+// values[i * size + j] swapped with values[j * size + i]
+void transpose_square(float *values, int size);
+
+#endif // ADVANCED_IMAGE_PROCESSOR_FFT_H__
@@ -1,7 +1,10 @@
 #include "handlers.h"
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <utility>
 
 #include <clip.h>
 #include <nfd.hpp>
@@ -10,13 +13,38 @@
 #include "algorithms.h"
 #include "image.h"
 #include "image_window.h"
+#include "jobs.h"
+#include "lazy_image.h"
 #include "models.h"
+#include "progress.h"
+#include "result_cache.h"
 #include "utility.h"
 
 void display_image_helper(const std::shared_ptr<Image> image, const std::string &title) {
     image_windows.emplace_back(std::make_shared<ImageWindow>(image, title));
 }
 
+void display_image_helper(const LazyImage &image, const std::string &title) {
+    image_windows.emplace_back(std::make_shared<ImageWindow>(image, title));
+}
+
+// copy of an image for a job, so the job doesn't share the image object with the main thread (pixels are shared until written)
+static std::shared_ptr<Image> make_job_input(const std::shared_ptr<Image> &image) {
+    return std::make_shared<Image>(*image);
+}
+
+// result of an operation from the result cache, computed and cached when missing (nullptr when canceled)
+template <typename F>
+static std::shared_ptr<Image> cached_result(const ResultKey &key, F &&compute) {
+    std::shared_ptr<Image> result = ResultCache::instance().find(key);
+    if (result != nullptr)
+        return result;
+
+    result = compute();
+    ResultCache::instance().insert(key, result);
+    return result;
+}
+
 std::string get_open_image_path() {
     if (NFD::Init() != NFD_OKAY)
         return std::string();
@@ -80,24 +108,29 @@ void handle_open_image_from_file() {
     }
 
     std::cout << "Open image: \"" << filepath << "\"" << std::endl;
-    std::shared_ptr<Image> image = std::make_shared<Image>(filepath);
-    if (!image->good()) {
-        std::cout << "Error: Open image \"" << filepath << "\" failed!" << std::endl;
-        return;
-    }
-    display_image_helper(image, filepath);
+    JobQueue::instance().submit([filepath]() -> JobQueue::Completion {
+        std::shared_ptr<Image> image = std::make_shared<Image>(filepath);
+        if (!image->good()) {
+            std::cout << "Error: Open image \"" << filepath << "\" failed!" << std::endl;
+            return nullptr;
+        }
+        return [=] { display_image_helper(image, filepath); };
+    });
 }
 
-void handle_save_iamge(const std::shared_ptr<Image> image) {
+void handle_save_iamge(const LazyImage &image) {
     std::string filepath = get_save_image_path();
     if (filepath.empty())
         return;
     std::cout << "Save image: \"" << filepath << "\"" << std::endl;
-    const bool result = image->saveToFile(filepath);
-    if (!result) {
-        std::cout << "Error: Save image \"" << filepath << "\" failed!" << std::endl;
-        return;
-    }
+    JobQueue::instance().submit([=]() -> JobQueue::Completion {
+        // a lazy image not displayed yet is computed here
+        const std::shared_ptr<Image> input_image = image.evaluate();
+        const bool result = input_image != nullptr && input_image->saveToFile(filepath);
+        if (!result)
+            std::cout << "Error: Save image \"" << filepath << "\" failed!" << std::endl;
+        return nullptr;
+    });
 }
 
 void handle_copy_image_title(const std::shared_ptr<ImageWindow> image_window) {
@@ -152,105 +185,154 @@ void handle_open_image_from_clipboard() {
         }
     }
 
-    image->loadToTexture();
     display_image_helper(image, "clipboard");
 }
 
-void handle_gray_histogram(const std::shared_ptr<Image> image) {
-    std::cout << "compute histogram" << std::endl;
-    std::shared_ptr<Image> gray_image = std::make_shared<Image>();
-    float histogram[256] = {};
-    generate_gray_image_and_histogram(image, gray_image, histogram);
-    display_image_helper(gray_image, "gray image");
-
-    std::cout << "generate histogram image" << std::endl;
-    const std::shared_ptr<Image> histogram_image = generate_histogram_image(histogram);
-    display_image_helper(histogram_image, "gray histogram");
+std::shared_ptr<Progress> handle_gray_histogram(const std::shared_ptr<Image> image) {
+    const std::shared_ptr<Image> input_image = make_job_input(image);
+    const std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+    JobQueue::instance().submit([=]() -> JobQueue::Completion {
+        std::cout << "compute histogram" << std::endl;
+        // one pass computing the gray image and its histogram
+        std::shared_ptr<Image> gray_image = std::make_shared<Image>();
+        float histogram[256] = {};
+        generate_gray_image_and_histogram(input_image, gray_image, histogram, progress.get());
+        if (progress->isCanceled())
+            return nullptr;
+
+        std::cout << "generate histogram image" << std::endl;
+        const std::shared_ptr<Image> histogram_image = generate_histogram_image(histogram);
+
+        return [=] {
+            display_image_helper(gray_image, "gray image");
+            display_image_helper(histogram_image, "gray histogram");
+        };
+    }, progress);
+    return progress;
 }
 
-void handle_gaussian_noise(const std::shared_ptr<Image> image, int sigma) {
-    const float sigma_normalized = sigma / 255.f;
-
-    // generate noise
-    const int num_pixels = image->getImageWidth() * image->getImageHeight();
-    float *noise = new float[num_pixels];
-    generate_gaussian_noise(noise, num_pixels, sigma_normalized);
-
-    // generate image with noise added
-    std::shared_ptr<Image> image_with_noise = std::make_shared<Image>(image->getImageWidth(), image->getImageHeight());
-    for (int y = 0; y < image->getImageHeight(); ++y) {
-        for (int x = 0; x < image->getImageWidth(); ++x) {
-            const int i = y * image->getImageWidth() + x;
-            image_with_noise->pixel(x, y)[Image::R] = clamp(image->pixel(x, y)[Image::R] + 255 * noise[i], 0.f, 255.f);
-            image_with_noise->pixel(x, y)[Image::G] = clamp(image->pixel(x, y)[Image::G] + 255 * noise[i], 0.f, 255.f);
-            image_with_noise->pixel(x, y)[Image::B] = clamp(image->pixel(x, y)[Image::B] + 255 * noise[i], 0.f, 255.f);
-            image_with_noise->pixel(x, y)[Image::A] = image->pixel(x, y)[Image::A];
-        }
-    }
-    image_with_noise->loadToTexture();
-    display_image_helper(image_with_noise, "image with noise");
-
-    // draw histogram of noise
-    for (int i = 0; i < num_pixels; ++i)
-        noise[i] += 0.5f;
-    float histogram[256] = {};
-    generate_histogram_from_array(noise, num_pixels, histogram);
-    std::shared_ptr<Image> noise_histogram_image = generate_histogram_image(histogram);
-    display_image_helper(noise_histogram_image, "noise histogram");
-
-    // clean
-    delete [] noise;
+std::shared_ptr<Progress> handle_gaussian_noise(const std::shared_ptr<Image> image, int sigma, uint64_t seed) {
+    const std::shared_ptr<Image> input_image = make_job_input(image);
+    const std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+    JobQueue::instance().submit([=]() -> JobQueue::Completion {
+        const float sigma_normalized = sigma / 255.f;
+
+        // generate noise once, drawn as a histogram now and added to the image when it is displayed
+        const int64_t num_pixels = (int64_t) input_image->getImageWidth() * input_image->getImageHeight();
+        const std::shared_ptr<float[]> noise(new float[num_pixels]);
+        generate_gaussian_noise(noise.get(), num_pixels, sigma_normalized, seed, progress.get());
+        if (progress->isCanceled())
+            return nullptr;
+
+        // draw histogram of noise
+        float histogram[256] = {};
+        generate_histogram_from_array(noise.get(), num_pixels, histogram, 0.5f);
+        std::shared_ptr<Image> noise_histogram_image = generate_histogram_image(histogram);
+
+        const LazyImage image_with_noise = LazyImage(input_image).noise(noise);
+
+        return [=] {
+            display_image_helper(image_with_noise, "image with noise");
+            display_image_helper(noise_histogram_image, "noise histogram");
+        };
+    }, progress);
+    return progress;
 }
 
-void handle_resize_image(const std::shared_ptr<Image> image, int width, int height) {
-    std::shared_ptr<Image> resized_image = std::make_shared<Image>(*image);
-    resized_image->resize(width, height);
-    display_image_helper(resized_image, "resized image");
+std::shared_ptr<Progress> handle_resize_image(const std::shared_ptr<Image> image, int width, int height) {
+    const std::shared_ptr<Image> resized_image = make_job_input(image);
+    const std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+    JobQueue::instance().submit([=]() -> JobQueue::Completion {
+        ResultKey key("resize", std::as_const(*resized_image).view());
+        key.add(width);
+        key.add(height);
+        const std::shared_ptr<Image> result = cached_result(key, [&] {
+            resized_image->resize(width, height);
+            return resized_image;
+        });
+        return [=] { display_image_helper(result, "resized image"); };
+    }, progress);
+    return progress;
 }
 
-void handle_haar_wavelet_transform(const std::shared_ptr<Image> image, int level, float scale) {
+std::shared_ptr<Progress> handle_haar_wavelet_transform(const std::shared_ptr<Image> image, int level, float scale) {
     // check
     if (level < 0) {
         std::cout << "level can't be negative!" << std::endl;
-        return;
+        return nullptr;
     }
 
-    // to grey
-    std::shared_ptr<Image> in_image = std::make_shared<Image>(*image);
-    generate_gray_image_and_histogram(image, in_image, nullptr);
-
-    // resize image
-    in_image->resize(
-        nearest_power_of_2(in_image->getImageWidth()),
-        nearest_power_of_2(in_image->getImageHeight()));
-
-    std::shared_ptr<Image> out_image = haar_wavelet_transform(in_image, level, scale);
-    out_image->loadToTexture();
-
-    display_image_helper(out_image, "haar wavelet result");
+    const std::shared_ptr<Image> input_image = make_job_input(image);
+    const std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+    JobQueue::instance().submit([=]() -> JobQueue::Completion {
+        ResultKey key("haar wavelet transform", std::as_const(*input_image).view());
+        key.add(level);
+        key.add(scale);
+        const std::shared_ptr<Image> out_image = cached_result(key, [&] {
+            return gray_haar_wavelet_transform(input_image, level, scale, progress.get());
+        });
+        if (out_image == nullptr)
+            return nullptr;
+
+        return [=] { display_image_helper(out_image, "haar wavelet result"); };
+    }, progress);
+    return progress;
 }
 
-void handle_histogram_equalization(const std::shared_ptr<Image> image) {
-    // input
-    std::shared_ptr<Image> input_image = std::make_shared<Image>();
-    float histogram[256] = {};
-    generate_gray_image_and_histogram(image, input_image, histogram);
-    const std::shared_ptr<Image> input_image_histogram = generate_histogram_image(histogram);
-    display_image_helper(input_image, "histogram equalization - input");
-    display_image_helper(input_image_histogram, "histogram equalization - input histogram");
-
-    // process
-    std::shared_ptr<Image> output_image = histogram_equalization(input_image);
-
-    // output
-    generate_gray_image_and_histogram(output_image, nullptr, histogram);
-    const std::shared_ptr<Image> output_image_histogram = generate_histogram_image(histogram);
-    display_image_helper(output_image, "histogram equalization - output");
-    display_image_helper(output_image_histogram, "histogram equalization - output histogram");
+std::shared_ptr<Progress> handle_histogram_equalization(const std::shared_ptr<Image> image) {
+    const std::shared_ptr<Image> source_image = make_job_input(image);
+    const std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+    JobQueue::instance().submit([=]() -> JobQueue::Completion {
+        // input
+        std::shared_ptr<Image> input_image = std::make_shared<Image>();
+        float histogram[256] = {};
+        generate_gray_image_and_histogram(source_image, input_image, histogram, progress.get());
+        if (progress->isCanceled())
+            return nullptr;
+        const std::shared_ptr<Image> input_image_histogram = generate_histogram_image(histogram);
+
+        // process
+        const std::shared_ptr<Image> output_image = cached_result(
+                ResultKey("histogram equalization", std::as_const(*input_image).view()),
+                [&] { return histogram_equalization(input_image, progress.get()); });
+        if (output_image == nullptr)
+            return nullptr;
+
+        // output
+        generate_gray_image_and_histogram(output_image, nullptr, histogram, progress.get());
+        if (progress->isCanceled())
+            return nullptr;
+        const std::shared_ptr<Image> output_image_histogram = generate_histogram_image(histogram);
+
+        return [=] {
+            display_image_helper(input_image, "histogram equalization - input");
+            display_image_helper(input_image_histogram, "histogram equalization - input histogram");
+            display_image_helper(output_image, "histogram equalization - output");
+            display_image_helper(output_image_histogram, "histogram equalization - output histogram");
+        };
+    }, progress);
+    return progress;
 }
 
-void handle_convolution(const std::shared_ptr<Image> image, int kernel_size, const std::shared_ptr<float[]> kernel,
-        ConvolutionEdgeHandlingMethod edge_handling_method) {
-    std::shared_ptr<Image> result = image_convolution(image, kernel_size, kernel.get(), edge_handling_method);
-    display_image_helper(result, "convolution result");
+std::shared_ptr<Progress> handle_convolution(const std::shared_ptr<Image> image, int kernel_size,
+        const std::shared_ptr<float[]> kernel, ConvolutionEdgeHandlingMethod edge_handling_method) {
+    // the kernel is still edited in the UI while the job runs
+    const std::shared_ptr<Image> input_image = make_job_input(image);
+    std::shared_ptr<float[]> kernel_copy(new float[kernel_size * kernel_size]);
+    std::copy(kernel.get(), kernel.get() + kernel_size * kernel_size, kernel_copy.get());
+
+    const std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+    JobQueue::instance().submit([=]() -> JobQueue::Completion {
+        ResultKey key("convolution", std::as_const(*input_image).view());
+        key.add(kernel_size);
+        key.add(edge_handling_method);
+        key.add(kernel_copy.get(), kernel_size * kernel_size * sizeof(float));
+        const std::shared_ptr<Image> result = cached_result(key, [&] {
+            return image_convolution(input_image, kernel_size, kernel_copy.get(), edge_handling_method, progress.get());
+        });
+        if (result == nullptr)
+            return nullptr;
+        return [=] { display_image_helper(result, "convolution result"); };
+    }, progress);
+    return progress;
 }
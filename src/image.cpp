@@ -1,24 +1,118 @@
 #include "image.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <cstring>
+#include <memory>
 #include <string>
-#include <GL/gl.h>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include <stb_image.h>
 #include <stb_image_write.h>
-#include <stb_image_resize.h>
 
-Image::Image() : _image_w(0), _image_h(0), _data(nullptr), _texture_id(0) {}
+#include "mapped_file.h"
+#include "pixel_kernels.h"
+#include "utility.h"
+
+// header of a raw pixel file, padded so the pixels start 64 byte aligned
+struct RawImageHeader {
+    char magic[8];
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    uint32_t data_offset;
+    uint8_t reserved[40];
+};
+
+static_assert(sizeof(RawImageHeader) == 64);
+
+static constexpr char raw_image_magic[8] = {'A', 'I', 'P', 'R', 'A', 'W', '0', '1'};
+// the pixels of a raw pixel file start at a multiple of it
+static constexpr uint32_t raw_image_alignment = 64;
+// modified regions remembered per image, older ones are merged
+static constexpr std::size_t max_dirty_regions = 16;
+
+// numbers of the versions of all images, so the versions of two images never match
+static uint64_t new_image_generation() {
+    static std::atomic<uint64_t> generation = 0;
+    return ++generation;
+}
+
+bool ImageRect::empty() const {
+    return w <= 0 || h <= 0;
+}
+
+ImageRect ImageRect::united(const ImageRect &other) const {
+    if (empty()) return other;
+    if (other.empty()) return *this;
+
+    const int left = std::min(x, other.x);
+    const int top = std::min(y, other.y);
+    const int right = std::max(x + w, other.x + other.w);
+    const int bottom = std::max(y + h, other.y + other.h);
+    return {left, top, right - left, bottom - top};
+}
 
-Image::Image(const Image &other): Image(other._image_w, other._image_h, other._data) {}
+/*
+ * Debug check of the copy-on-write: pixels shared by copies of an image are
+ * hashed when they become shared, and the hash is checked when a copy
+ * detaches from them or releases them. A mismatch means a pointer or view
+ * taken before the copy was written through.
+ */
+static void begin_sharing(PixelBuffer *buffer) {
+#ifndef NDEBUG
+    if (buffer == nullptr)
+        return;
+    const uint64_t hash = std::hash<std::string_view>()(std::string_view((const char *) buffer->data(), buffer->size())) | 1;
+    uint64_t shared_hash = 0;
+    if (!buffer->shared_hash.compare_exchange_strong(shared_hash, hash))
+        assert(shared_hash == hash && "pixels shared by copies of an image were written after the copy");
+#endif
+}
+
+static void check_sharing(PixelBuffer *buffer, bool is_still_shared) {
+#ifndef NDEBUG
+    if (buffer == nullptr || buffer->shared_hash == 0)
+        return;
+    const uint64_t hash = std::hash<std::string_view>()(std::string_view((const char *) buffer->data(), buffer->size())) | 1;
+    assert(buffer->shared_hash == hash && "pixels shared by copies of an image were written after the copy");
+    if (!is_still_shared)
+        buffer->shared_hash = 0;
+#endif
+}
+
+Image::Image() : _image_w(0), _image_h(0) {
+    markDirty();
+}
+
+Image::Image(const Image &other) : _image_w(other._image_w), _image_h(other._image_h), _buffer(other._buffer) {
+    begin_sharing(_buffer.get());
+    markDirty();
+}
+
+Image::Image(Image &&other) noexcept :
+        _image_w(std::exchange(other._image_w, 0)), _image_h(std::exchange(other._image_h, 0)),
+        _buffer(std::move(other._buffer)) {
+    markDirty();
+    other.markDirty();
+}
 
 Image::Image(int width, int height, const uint8_t *data) : Image() {
     init(width, height, data);
 }
 
+Image::Image(int width, int height, InitMode init_mode) : Image() {
+    init(width, height, init_mode);
+}
+
 Image::Image(const std::string &filepath) : Image() {
     loadFromFile(filepath);
 }
@@ -27,7 +121,42 @@ Image::~Image() {
     close();
 }
 
+Image &Image::operator=(const Image &other) {
+    if (this != &other) {
+        _image_w = other._image_w;
+        _image_h = other._image_h;
+        _buffer = other._buffer;
+        begin_sharing(_buffer.get());
+        markDirty();
+    }
+    return *this;
+}
+
+Image &Image::operator=(Image &&other) noexcept {
+    if (this != &other) {
+        _image_w = std::exchange(other._image_w, 0);
+        _image_h = std::exchange(other._image_h, 0);
+        _buffer = std::move(other._buffer);
+        markDirty();
+        other.markDirty();
+    }
+    return *this;
+}
+
 void Image::init(int width, int height, const uint8_t *data) {
+    init(width, height, INIT_UNINITIALIZED);
+
+    const std::size_t size_in_bytes = _buffer->size();
+    if (data == nullptr) {
+        // set default color to white
+        memset(_buffer->data(), 255, size_in_bytes);
+    } else {
+        // copy pixel data
+        memcpy(_buffer->data(), data, size_in_bytes);
+    }
+}
+
+void Image::init(int width, int height, InitMode init_mode) {
     // close previous image
     close();
 
@@ -35,35 +164,27 @@ void Image::init(int width, int height, const uint8_t *data) {
     _image_h = height;
 
     // create pixel data array
-    const int size_in_bytes = 4 * _image_w * _image_h * sizeof(uint8_t);
-    _data = new uint8_t[size_in_bytes];
+    const std::size_t size_in_bytes = 4 * (std::size_t) _image_w * _image_h * sizeof(uint8_t);
+    _buffer = std::make_shared<PixelBuffer>(size_in_bytes);
 
-    if (data == nullptr) {
-        // set default color to white
-        memset(_data, 255, size_in_bytes * sizeof(uint8_t));
-    } else {
-        // copy pixel data
-        memcpy(_data, data, size_in_bytes);
-    }
+    if (init_mode == INIT_WHITE)
+        memset(_buffer->data(), 255, size_in_bytes);
 
-    // create a OpenGL texture
-    glGenTextures(1, &_texture_id);
-    loadToTexture();
+    markDirty();
 }
 
 void Image::close() {
-    if (_data != nullptr) {
-        delete [] _data;
-        glDeleteTextures(1, &_texture_id);
+    if (_buffer != nullptr) {
+        check_sharing(_buffer.get(), _buffer.use_count() > 1);
+        _buffer.reset();
         _image_w = 0;
         _image_h = 0;
-        _data = nullptr;
-        _texture_id = 0;
+        markDirty();
     }
 }
 
 bool Image::good() const {
-    return _data != nullptr;
+    return _buffer != nullptr;
 }
 
 bool Image::loadFromFile(const std::string &filepath) {
@@ -87,15 +208,82 @@ bool Image::saveToFile(const std::string &filepath) const {
 
     if (file_extension == ".jpg") {
         constexpr int quality = 95;
-        return stbi_write_jpg(filepath.c_str(), _image_w, _image_h, 4, _data, quality) != 0;
+        return stbi_write_jpg(filepath.c_str(), _image_w, _image_h, 4, data(), quality) != 0;
     } else if (file_extension == ".png") {
         const int stride_in_bytes = _image_w * 4;
-        return stbi_write_png(filepath.c_str(), _image_w, _image_h, 4, _data, stride_in_bytes) != 0;
+        return stbi_write_png(filepath.c_str(), _image_w, _image_h, 4, data(), stride_in_bytes) != 0;
     } else {
         return false;
     }
 }
 
+bool Image::mapRawFile(const std::string &filepath, bool writable) {
+    std::unique_ptr<MappedFile> mapping = std::make_unique<MappedFile>();
+    if (!mapping->open(filepath, writable ? MappedFile::MODE_READ_WRITE : MappedFile::MODE_READ_ONLY))
+        return false;
+
+    // check the header
+    if (mapping->size() < sizeof(RawImageHeader))
+        return false;
+    RawImageHeader header;
+    memcpy(&header, mapping->data(), sizeof(header));
+    const std::size_t size_in_bytes = 4 * (std::size_t) header.width * header.height;
+    if (memcmp(header.magic, raw_image_magic, sizeof(raw_image_magic)) != 0 || header.channels != 4 ||
+        header.width == 0 || header.height == 0 || header.width > INT32_MAX || header.height > INT32_MAX ||
+        header.data_offset < sizeof(header) || header.data_offset % raw_image_alignment != 0)
+        return false;
+    // the pixels must be inside the file, which a truncated file or a wrong offset doesn't ensure
+    if (header.data_offset > mapping->size() || mapping->size() - header.data_offset < size_in_bytes)
+        return false;
+
+    close();
+    _image_w = (int) header.width;
+    _image_h = (int) header.height;
+    _buffer = std::make_shared<PixelBuffer>(std::move(mapping), header.data_offset, size_in_bytes);
+    markDirty();
+
+    return true;
+}
+
+bool Image::saveRawFile(const std::string &filepath) const {
+    if (!good())
+        return false;
+
+    RawImageHeader header = {};
+    memcpy(header.magic, raw_image_magic, sizeof(raw_image_magic));
+    header.width = _image_w;
+    header.height = _image_h;
+    header.channels = 4;
+    header.data_offset = sizeof(header);
+
+    std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(data()), (std::streamsize) _buffer->size());
+    return file.good();
+}
+
+bool Image::initFileBacked(int width, int height, InitMode init_mode, const std::string &directory) {
+    const std::size_t size_in_bytes = 4 * (std::size_t) width * height * sizeof(uint8_t);
+    std::unique_ptr<MappedFile> mapping = std::make_unique<MappedFile>();
+    if (width <= 0 || height <= 0 || !mapping->open(directory, MappedFile::MODE_TEMPORARY, size_in_bytes))
+        return false;
+
+    close();
+    _image_w = width;
+    _image_h = height;
+    _buffer = std::make_shared<PixelBuffer>(std::move(mapping), 0, size_in_bytes);
+
+    if (init_mode == INIT_WHITE)
+        memset(_buffer->data(), 255, size_in_bytes);
+
+    markDirty();
+    return true;
+}
+
+bool Image::isFileBacked() const {
+    return _buffer != nullptr && _buffer->isMapped();
+}
+
 int Image::getImageWidth() const {
     return _image_w;
 }
@@ -105,15 +293,36 @@ int Image::getImageHeight() const {
 }
 
 const uint8_t *Image::data() const {
-    return _data;
+    return _buffer != nullptr ? _buffer->data() : nullptr;
 }
 
 const uint8_t *Image::pixel(int x, int y) const {
-    return &_data[(y * _image_w + x) * 4 * sizeof(uint8_t)];
+    return &_buffer->data()[((std::size_t) y * _image_w + x) * 4 * sizeof(uint8_t)];
 }
 
 uint8_t *Image::pixel(int x, int y) {
-    return &_data[(y * _image_w + x) * 4 * sizeof(uint8_t)];
+    detach();
+    return &_buffer->data()[((std::size_t) y * _image_w + x) * 4 * sizeof(uint8_t)];
+}
+
+ImageView Image::view() {
+    detach();
+    markDirty();
+    return ImageView(_buffer != nullptr ? _buffer->data() : nullptr, _image_w, _image_h);
+}
+
+ConstImageView Image::view() const {
+    return ConstImageView(data(), _image_w, _image_h);
+}
+
+ImageView Image::view(int x, int y, int width, int height) {
+    detach();
+    markDirty(x, y, width, height);
+    return ImageView(_buffer != nullptr ? _buffer->data() : nullptr, _image_w, _image_h).subview(x, y, width, height);
+}
+
+ConstImageView Image::view(int x, int y, int width, int height) const {
+    return view().subview(x, y, width, height);
 }
 
 void Image::fill(uint8_t level, uint8_t a) {
@@ -121,59 +330,89 @@ void Image::fill(uint8_t level, uint8_t a) {
 }
 
 void Image::fill(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    // one detach for the whole image, then plain writes to the rows
+    const ImageView pixels = view();
+    const uint8_t color[4] = {r, g, b, a};
     for (int y = 0; y < _image_h; ++y) {
-        for (int x = 0; x < _image_w; ++x) {
-            pixel(x, y)[R] = r;
-            pixel(x, y)[G] = g;
-            pixel(x, y)[B] = b;
-            pixel(x, y)[A] = a;
-        }
+        uint8_t *row = pixels.row(y);
+        for (int x = 0; x < _image_w; ++x)
+            memcpy(row + x * 4, color, sizeof(color));
     }
 }
 
 bool Image::resize(int width, int height) {
-    if (width <= 0 || height <= 0)
+    if (width <= 0 || height <= 0 || _buffer == nullptr)
         return false;
 
     // create pixel data array
-    const int size_in_bytes = 4 * width * height * sizeof(uint8_t);
-    uint8_t *new_pixels = new uint8_t[size_in_bytes];
+    const std::size_t size_in_bytes = 4 * (std::size_t) width * height * sizeof(uint8_t);
+    std::shared_ptr<PixelBuffer> new_pixels = std::make_shared<PixelBuffer>(size_in_bytes);
 
-    // resize image
-    const bool result = stbir_resize_uint8(
-            _data, _image_w, _image_h, 0,
-            new_pixels, width, height, 0, 4);
+    // resize image (the source pixels may be shared, they're only read)
+    const bool result = get_pixel_kernels().resize(
+            _buffer->data(), _image_w, _image_h, 0,
+            new_pixels->data(), width, height, 0, 4);
 
-    if (!result) {
-        delete [] new_pixels;
+    if (!result)
         return false;
-    }
 
     // save result
-    uint8_t *old_pixels = _data;
-    _data = new_pixels;
-    delete [] old_pixels;
+    _buffer = std::move(new_pixels);
     _image_w = width;
     _image_h = height;
+    markDirty();
 
     return true;
 }
 
-void Image::loadToTexture() const {
-    // use texture
-    glBindTexture(GL_TEXTURE_2D, _texture_id);
+void Image::detach() {
+    check_sharing(_buffer.get(), _buffer.use_count() > 1);
 
-    // setup filtering parameters for display
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // give this image its own copy of shared or read-only mapped pixels before writing
+    if (_buffer != nullptr && (_buffer.use_count() > 1 || !_buffer->isWritable())) {
+        std::shared_ptr<PixelBuffer> own_buffer = std::make_shared<PixelBuffer>(_buffer->size());
+        memcpy(own_buffer->data(), _buffer->data(), _buffer->size());
+        _buffer = std::move(own_buffer);
+    }
+}
 
-    // upload pixels into texture
-#if defined(GL_UNPACK_ROW_LENGTH) && !defined(__EMSCRIPTEN__)
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-#endif
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _image_w, _image_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, _data);
+void Image::markDirty() {
+    const uint64_t generation = new_image_generation();
+    _version = {generation, generation};
+    _dirty_regions.clear();
+}
+
+void Image::markDirty(int x, int y, int width, int height) {
+    // clip to the image bounds
+    const int left = clamp(x, 0, _image_w);
+    const int top = clamp(y, 0, _image_h);
+    const int right = clamp(x + width, 0, _image_w);
+    const int bottom = clamp(y + height, 0, _image_h);
+    const ImageRect rect = {left, top, right - left, bottom - top};
+    if (rect.empty())
+        return;
+
+    _version.generation = new_image_generation();
+    _dirty_regions.push_back({_version.generation, rect});
+    if (_dirty_regions.size() > max_dirty_regions) {
+        // the merged region is reported to the consumers of either generation, a superset for the older one
+        _dirty_regions[1].rect = _dirty_regions[1].rect.united(_dirty_regions[0].rect);
+        _dirty_regions.erase(_dirty_regions.begin());
+    }
+}
+
+ImageVersion Image::getVersion() const {
+    return _version;
 }
 
-GLuint Image::getTextureId() const {
-    return _texture_id;
+ImageRect Image::getDirtyRectSince(const ImageVersion &version) const {
+    if (version.content != _version.content)
+        return {0, 0, _image_w, _image_h};
+
+    ImageRect dirty_rect = {0, 0, 0, 0};
+    for (const DirtyRegion &region : _dirty_regions) {
+        if (region.generation > version.generation)
+            dirty_rect = dirty_rect.united(region.rect);
+    }
+    return dirty_rect;
 }
@@ -2,45 +2,125 @@
 #define ADVANCED_IMAGE_PROCESSOR_IMAGE_H__
 
 #include <cstdint>
+#include <memory>
 #include <string>
-#include <GL/gl.h>
+#include <vector>
 
+#include "image_view.h"
+#include "pixel_buffer.h"
+
+struct ImageRect {
+    int x;
+    int y;
+    int w;
+    int h;
+
+    bool empty() const;
+    ImageRect united(const ImageRect &other) const;
+};
+
+// state of the pixels of an image, which a consumer keeping its own copy (e.g. a texture) compares to its last one
+struct ImageVersion {
+    uint64_t content = 0;     // new whenever all pixels may have changed, never the same for two images
+    uint64_t generation = 0;  // new with every modification
+
+    bool operator==(const ImageVersion &other) const = default;
+};
+
+/*
+ * RGBA image with 8 bits per channel.
+ *
+ * Pixels are shared between copies of an image (copy-on-write), so copying
+ * is O(1). Non-const pixel accessors give the image its own copy of the
+ * pixels first when they are shared, but only then: a pointer or view taken
+ * before the image is copied still points at the shared pixels, and writes
+ * through it would show in the copy. Such pointers and views are invalid
+ * once the image is copied; take them again after the copy. Debug builds
+ * assert that shared pixels are unchanged when a copy detaches from them
+ * or releases them, which catches such writes. An image
+ * object itself must not be accessed from several threads at once, but
+ * copies can be used from different threads.
+ *
+ * Pixels can also live in a file mapping instead of memory: a raw pixel
+ * file mapped read-only is copied to memory on the first write, a temporary
+ * file-backed image spills to disk instead of using memory.
+ */
 class Image {
 public:
 
     enum Color { R = 0, G, B, A };
 
+    // initial content of new pixels
+    enum InitMode {
+        INIT_WHITE,
+        INIT_UNINITIALIZED  // for callers overwriting every channel of every pixel
+    };
+
     Image();
     Image(const Image &other);
+    Image(Image &&other) noexcept;
     Image(int width, int height, const uint8_t *data=nullptr);
+    Image(int width, int height, InitMode init_mode);
     Image(const std::string &filepath);
     ~Image();
 
+    Image &operator=(const Image &other);
+    Image &operator=(Image &&other) noexcept;
+
     void init(int width, int height, const uint8_t *data=nullptr);
+    void init(int width, int height, InitMode init_mode);
     void close();
     bool good() const;
 
     bool loadFromFile(const std::string &filepath);
     bool saveToFile(const std::string &filepath) const;
 
+    // uncompressed pixel files which can be mapped into memory instead of decoded
+    bool mapRawFile(const std::string &filepath, bool writable=false);
+    bool saveRawFile(const std::string &filepath) const;
+    // pixels in a temporary file of the directory (or the system temporary directory)
+    bool initFileBacked(int width, int height, InitMode init_mode=INIT_WHITE, const std::string &directory="");
+    bool isFileBacked() const;
+
     int getImageWidth() const;
     int getImageHeight() const;
     const uint8_t *data() const;
     const uint8_t *pixel(int x, int y) const;
     uint8_t *pixel(int x, int y);
 
+    // non-owning views of the whole image or of a region; a non-const view marks its region dirty when it is taken
+    // and, like a pointer from non-const pixel(), must not be written through after the image was copied
+    ImageView view();
+    ConstImageView view() const;
+    ImageView view(int x, int y, int width, int height);
+    ConstImageView view(int x, int y, int width, int height) const;
+
     void fill(uint8_t level, uint8_t a=255);
     void fill(uint8_t r, uint8_t g, uint8_t b, uint8_t a=255);
     bool resize(int width, int height);
 
-    void loadToTexture() const;
-    GLuint getTextureId() const;
+    // modified pixels, writes through pixel() must be marked by the caller
+    void markDirty();
+    void markDirty(int x, int y, int width, int height);
+    ImageVersion getVersion() const;
+    // pixels modified since the version, the whole image for a version of other content
+    ImageRect getDirtyRectSince(const ImageVersion &version) const;
 
 private:
+    // a modified region and the generation it was modified in
+    struct DirtyRegion {
+        uint64_t generation;
+        ImageRect rect;
+    };
+
+    void detach();
+
     int _image_w;
     int _image_h;
-    uint8_t *_data;
-    GLuint _texture_id;
+    std::shared_ptr<PixelBuffer> _buffer;
+    ImageVersion _version;
+    // regions modified since the content changed, oldest first
+    std::vector<DirtyRegion> _dirty_regions;
 };
 
 #endif // ADVANCED_IMAGE_PROCESSOR_IMAGE_H__
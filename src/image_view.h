@@ -0,0 +1,72 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_IMAGE_VIEW_H__
+#define ADVANCED_IMAGE_PROCESSOR_IMAGE_VIEW_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+ * Non-owning view of interleaved pixels.
+ *
+ * A view doesn't own its pixels, so it is cheap to copy and must not outlive
+ * the storage it refers to. Rows are `stride` elements (not pixels) apart,
+ * which lets a view refer to a region of a larger image without copying.
+ */
+template <typename T, int C=4>
+class BasicImageView {
+public:
+
+    using value_type = T;
+    static constexpr int channels = C;
+
+    BasicImageView() : _data(nullptr), _image_w(0), _image_h(0), _stride(0) {}
+
+    BasicImageView(T *data, int width, int height, std::ptrdiff_t stride=0) :
+            _data(data), _image_w(width), _image_h(height),
+            _stride(stride != 0 ? stride : (std::ptrdiff_t) width * C) {}
+
+    // a mutable view converts implicitly to a read-only view
+    template <typename U>
+        requires (std::is_same_v<const U, T> && !std::is_same_v<U, T>)
+    BasicImageView(const BasicImageView<U, C> &other) :
+            BasicImageView(other.data(), other.getImageWidth(), other.getImageHeight(), other.getStride()) {}
+
+    bool empty() const { return _data == nullptr || _image_w <= 0 || _image_h <= 0; }
+    int getImageWidth() const { return _image_w; }
+    int getImageHeight() const { return _image_h; }
+    std::ptrdiff_t getStride() const { return _stride; }
+    bool isContiguous() const { return _stride == (std::ptrdiff_t) _image_w * C; }
+
+    T *data() const { return _data; }
+    T *row(int y) const { return _data + y * _stride; }
+    T *pixel(int x, int y) const { return _data + y * _stride + (std::ptrdiff_t) x * C; }
+
+    // region of interest, clipped to the bounds of this view
+    BasicImageView subview(int x, int y, int width, int height) const {
+        const int left = x < 0 ? 0 : x > _image_w ? _image_w : x;
+        const int top = y < 0 ? 0 : y > _image_h ? _image_h : y;
+        const int right = x + width < left ? left : x + width > _image_w ? _image_w : x + width;
+        const int bottom = y + height < top ? top : y + height > _image_h ? _image_h : y + height;
+        return BasicImageView(pixel(left, top), right - left, bottom - top, _stride);
+    }
+
+private:
+    T *_data;
+    int _image_w;
+    int _image_h;
+    std::ptrdiff_t _stride;
+};
+
+// copy pixels between views of the same size
+template <typename T, int C>
+void copy_pixels(const BasicImageView<const std::type_identity_t<T>, C> &src, const BasicImageView<T, C> &dst) {
+    const std::size_t row_size = (std::size_t) src.getImageWidth() * C * sizeof(T);
+    for (int y = 0; y < src.getImageHeight(); ++y)
+        std::memcpy(dst.row(y), src.row(y), row_size);
+}
+
+using ImageView = BasicImageView<uint8_t>;
+using ConstImageView = BasicImageView<const uint8_t>;
+
+#endif // ADVANCED_IMAGE_PROCESSOR_IMAGE_VIEW_H__
@@ -1,18 +1,31 @@
 #include "image_window.h"
 
+#include <algorithm>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <imgui.h>
 
 #include "image.h"
-#include "utility.h"
+#include "jobs.h"
+#include "lazy_image.h"
+#include "progress.h"
+#include "texture.h"
 
 int ImageWindow::_prev_id = 0;
 
 ImageWindow::ImageWindow(std::shared_ptr<Image> image, const std::string &title) :
         is_first_seen(true), is_open(true),
         scale_type(SCALE_ORIGINAL), scale_factor(1.f),
-        _id(++_prev_id), _image(image) {
+        _id(++_prev_id), _image(image), _is_evaluating(false) {
+    setTitle(title);
+}
+
+ImageWindow::ImageWindow(const LazyImage &lazy_image, const std::string &title) :
+        is_first_seen(true), is_open(true),
+        scale_type(SCALE_ORIGINAL), scale_factor(1.f),
+        _id(++_prev_id), _lazy_image(lazy_image), _is_evaluating(false) {
     setTitle(title);
 }
 
@@ -28,6 +41,55 @@ void ImageWindow::setImage(std::shared_ptr<Image> image) {
     _image = image;
 }
 
+LazyImage ImageWindow::getLazyImage() const {
+    return isEvaluated() ? LazyImage(_image) : _lazy_image;
+}
+
+bool ImageWindow::isEvaluated() const {
+    return _image != nullptr;
+}
+
+void ImageWindow::evaluate() {
+    if (isEvaluated() || _is_evaluating)
+        return;
+    _is_evaluating = true;
+
+    // the window is closed when the evaluation is canceled
+    const std::shared_ptr<ImageWindow> image_window = shared_from_this();
+    const LazyImage lazy_image = _lazy_image;
+    const std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+    JobQueue::instance().submit([=]() -> JobQueue::Completion {
+        const std::shared_ptr<Image> image = lazy_image.evaluate(progress.get());
+        return [=] {
+            image_window->_is_evaluating = false;
+            if (image == nullptr) {
+                image_window->is_open = false;
+                return;
+            }
+            image_window->setImage(image);
+            image_window->_lazy_image = LazyImage();
+        };
+    }, progress);
+    addOperation("Evaluate", progress);
+}
+
+int ImageWindow::getImageWidth() const {
+    return isEvaluated() ? _image->getImageWidth() : _lazy_image.getImageWidth();
+}
+
+int ImageWindow::getImageHeight() const {
+    return isEvaluated() ? _image->getImageHeight() : _lazy_image.getImageHeight();
+}
+
+void ImageWindow::updateTexture() {
+    if (_image != nullptr)
+        _texture.update(*_image);
+}
+
+GLuint ImageWindow::getTextureId() const {
+    return _texture.getTextureId();
+}
+
 const std::string &ImageWindow::getTitle() const {
     return _title;
 }
@@ -38,24 +100,37 @@ void ImageWindow::setTitle(const std::string &title) {
 }
 
 std::string ImageWindow::getDisplayedTitle() const {
-    return _title + "  [" + std::to_string(_image->getImageWidth()) + " x " + std::to_string(_image->getImageHeight()) + "]";
+    return _title + "  [" + std::to_string(getImageWidth()) + " x " + std::to_string(getImageHeight()) + "]";
 }
 
 const std::string &ImageWindow::getRenderedTitle() const {
     return _ui_title;
 }
 
+void ImageWindow::addOperation(const std::string &name, std::shared_ptr<Progress> progress) {
+    if (progress != nullptr)
+        _operations.push_back({name, progress});
+}
+
+void ImageWindow::removeFinishedOperations() {
+    std::erase_if(_operations, [](const Operation &operation) { return operation.progress->isFinished(); });
+}
+
+const std::vector<ImageWindow::Operation> &ImageWindow::getOperations() const {
+    return _operations;
+}
+
 ImVec2 ImageWindow::computeImageRenderSize(const ImVec2 &window_size) const {
     if (scale_type == SCALE_ORIGINAL)
-        return ImVec2(_image->getImageWidth(), _image->getImageHeight());
+        return ImVec2(getImageWidth(), getImageHeight());
 
     if (scale_type == SCALE_CUSTOM_SCALE)
-        return ImVec2(scale_factor * _image->getImageWidth(), scale_factor * _image->getImageHeight());
+        return ImVec2(scale_factor * getImageWidth(), scale_factor * getImageHeight());
 
     if (scale_type == SCALE_FILL)
         return ImVec2(window_size.x, window_size.y);
 
-    const float image_aspect_ratio = (float) _image->getImageWidth() / _image->getImageHeight();
+    const float image_aspect_ratio = (float) getImageWidth() / getImageHeight();
     const float window_aspect_ratio = (float) window_size.x / window_size.y;
 
     if (scale_type == SCALE_FIT_WIDTH ||
@@ -78,3 +153,16 @@ ImVec2 ImageWindow::computeDefaultPosition() const {
         offset + _id % max_step * step,
         offset + _id % max_step * step);
 }
+
+ImVec2 compute_max_target_size(const ImVec2 &target_size, const ImVec2 &box_size) {
+    if (target_size.x <= box_size.x && target_size.y <= box_size.y)
+        return target_size;
+
+    const float target_aspect_ratio = target_size.x / target_size.y;
+    const float box_aspect_ratio = box_size.x / box_size.y;
+
+    if (target_aspect_ratio > box_aspect_ratio) // target is wider
+        return ImVec2(box_size.x, box_size.x / target_aspect_ratio);
+    else  // target is taller
+        return ImVec2(box_size.y * target_aspect_ratio, box_size.y);
+}
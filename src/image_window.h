@@ -3,12 +3,20 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "imgui.h"
 
 #include "image.h"
+#include "lazy_image.h"
+#include "progress.h"
+#include "texture.h"
 
-class ImageWindow {
+/*
+ * A window shows an image, or a lazy image until it is evaluated: the
+ * evaluation starts as a job the first time the window is drawn expanded.
+ */
+class ImageWindow : public std::enable_shared_from_this<ImageWindow> {
 public:
 
     enum ScaleType {
@@ -20,22 +28,41 @@ public:
         SCALE_CUSTOM_SCALE
     };
 
+    // operation started from the window, running in the background
+    struct Operation {
+        std::string name;
+        std::shared_ptr<Progress> progress;
+    };
+
     bool is_first_seen;
     bool is_open;
     ScaleType scale_type;
     float scale_factor;
 
     ImageWindow(std::shared_ptr<Image> image=nullptr, const std::string &title="");
+    ImageWindow(const LazyImage &lazy_image, const std::string &title="");
     ImageWindow(const ImageWindow &other) = delete;
 
     const std::shared_ptr<Image> getImage() const;
     std::shared_ptr<Image> getImage();
     void setImage(std::shared_ptr<Image> image);
+    // the image, or the lazy image not evaluated yet
+    LazyImage getLazyImage() const;
+    bool isEvaluated() const;
+    void evaluate();
+    int getImageWidth() const;
+    int getImageHeight() const;
+    void updateTexture();
+    GLuint getTextureId() const;
     const std::string &getTitle() const;
     void setTitle(const std::string &title);
     std::string getDisplayedTitle() const;
     const std::string &getRenderedTitle() const;
 
+    void addOperation(const std::string &name, std::shared_ptr<Progress> progress);
+    void removeFinishedOperations();
+    const std::vector<Operation> &getOperations() const;
+
     ImVec2 computeImageRenderSize(const ImVec2 &window_size=ImVec2()) const;
     ImVec2 computeDefaultPosition() const;
 
@@ -44,8 +71,14 @@ private:
 
     const int _id;
     std::shared_ptr<Image> _image;
+    LazyImage _lazy_image;
+    bool _is_evaluating;
+    Texture _texture;
     std::string _title;
     std::string _ui_title;
+    std::vector<Operation> _operations;
 };
 
+ImVec2 compute_max_target_size(const ImVec2 &target_size, const ImVec2 &box_size);
+
 #endif // ADVANCED_IMAGE_PROCESSOR_IMAGE_WINDOW_H__
@@ -0,0 +1,93 @@
+#include "jobs.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "progress.h"
+#include "thread_pool.h"
+
+JobQueue &JobQueue::instance() {
+    // a few jobs run at once, each spreading its work over the shared thread pool
+    static JobQueue queue(4);
+    return queue;
+}
+
+JobQueue::JobQueue(int num_threads) : _active_count(0), _stop(false) {
+    // create the thread pool first, so it outlives the jobs using it when static objects are destroyed
+    ThreadPool::instance();
+
+    for (int i = 0; i < num_threads; ++i)
+        _threads.emplace_back(&JobQueue::threadLoop, this);
+}
+
+JobQueue::~JobQueue() {
+    // queued jobs are dropped, running jobs are finished
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        _jobs.clear();
+    }
+    _wake.notify_all();
+    for (std::thread &thread : _threads)
+        thread.join();
+}
+
+void JobQueue::submit(Job job, std::shared_ptr<Progress> progress) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back({std::move(job), std::move(progress)});
+        ++_active_count;
+    }
+    _wake.notify_one();
+}
+
+void JobQueue::runCompletions() {
+    std::vector<Completion> completions;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        completions.swap(_completions);
+    }
+
+    for (Completion &completion : completions) {
+        if (completion)
+            completion();
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _active_count -= (int) completions.size();
+}
+
+int JobQueue::getActiveCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _active_count;
+}
+
+void JobQueue::threadLoop() {
+    while (true) {
+        QueuedJob queued_job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [this] { return _stop || !_jobs.empty(); });
+            if (_stop)
+                return;
+            queued_job = std::move(_jobs.front());
+            _jobs.pop_front();
+        }
+
+        Completion completion;
+        if (!is_canceled(queued_job.progress.get()))
+            completion = queued_job.job();
+
+        // release what the job holds (its input) before its completion runs
+        queued_job.job = nullptr;
+        if (queued_job.progress != nullptr)
+            queued_job.progress->finish();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _completions.push_back(std::move(completion));
+    }
+}
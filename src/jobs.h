@@ -0,0 +1,62 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_JOBS_H__
+#define ADVANCED_IMAGE_PROCESSOR_JOBS_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "progress.h"
+
+/*
+ * Background jobs for operations started from the UI.
+ *
+ * A job runs on one of the job threads and returns a completion, which the
+ * main thread runs in runCompletions(). Completions may therefore touch
+ * state only the main thread may use (image windows, textures), the job
+ * itself must not.
+ *
+ * A job may come with the progress it reports to. It is marked finished
+ * when the job returned, and a job canceled before it started is skipped.
+ */
+class JobQueue {
+public:
+
+    using Completion = std::function<void()>;
+    using Job = std::function<Completion()>;
+
+    static JobQueue &instance();
+
+    explicit JobQueue(int num_threads);
+    JobQueue(const JobQueue &other) = delete;
+    ~JobQueue();
+
+    JobQueue &operator=(const JobQueue &other) = delete;
+
+    void submit(Job job, std::shared_ptr<Progress> progress=nullptr);
+    // run the completions of finished jobs, called by the main thread once per frame
+    void runCompletions();
+    // jobs submitted whose completion hasn't run yet
+    int getActiveCount() const;
+
+private:
+    struct QueuedJob {
+        Job job;
+        std::shared_ptr<Progress> progress;
+    };
+
+    void threadLoop();
+
+    std::vector<std::thread> _threads;
+    std::deque<QueuedJob> _jobs;
+    std::vector<Completion> _completions;
+    mutable std::mutex _mutex;
+    std::condition_variable _wake;
+    int _active_count;
+    bool _stop;
+};
+
+#endif // ADVANCED_IMAGE_PROCESSOR_JOBS_H__
@@ -0,0 +1,258 @@
+#include "lazy_image.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "algorithms.h"
+#include "image.h"
+#include "image_view.h"
+#include "pixel_kernels.h"
+#include "progress.h"
+#include "scratch_arena.h"
+#include "thread_pool.h"
+#include "tile_pipeline.h"
+
+// point operation of a fused pass, lookup tables already folded together
+struct FusedStep {
+    enum Type { GRAY, LOOKUP_TABLE, NOISE };
+
+    Type type;
+    uint8_t lut[256];
+    float sigma;
+    uint64_t seed;
+    const float *noise_values;  // generated from sigma and seed when nullptr
+};
+
+/*
+ * Run the steps on the rows of the image, in place on the output: each row
+ * is copied to the output once and goes through all steps while it is in
+ * the cache. Same kernels as convert_to_gray, apply_lookup_table and
+ * add_noise.
+ */
+static void run_fused_steps(ConstImageView image, ImageView out_image, const std::vector<FusedStep> &steps,
+        Progress *progress) {
+    const int width = image.getImageWidth();
+    const bool has_gray = std::any_of(steps.begin(), steps.end(),
+            [](const FusedStep &step) { return step.type == FusedStep::GRAY; });
+    const bool has_noise = std::any_of(steps.begin(), steps.end(),
+            [](const FusedStep &step) { return step.type == FusedStep::NOISE; });
+    const PixelKernels &kernels = get_pixel_kernels();
+
+    if (progress != nullptr)
+        progress->addTotal(image.getImageHeight());
+    parallel_for_rows(width, image.getImageHeight(), [&](int y_begin, int y_end) {
+        ScratchScope scratch;
+        uint8_t *row_levels = has_gray ? scratch.arena().allocate<uint8_t>(width) : nullptr;
+        float *row_noise = has_noise ? scratch.arena().allocate<float>(width) : nullptr;
+        for (int y = y_begin; y < y_end; ++y) {
+            uint8_t *row = out_image.row(y);
+            if (image.row(y) != row)
+                std::memcpy(row, image.row(y), (std::size_t) width * 4);
+
+            for (const FusedStep &step : steps) {
+                if (step.type == FusedStep::GRAY) {
+                    kernels.gray_row(row, row_levels, width);
+                    for (int x = 0; x < width; ++x) {
+                        uint8_t *pixel = row + x * 4;
+                        pixel[Image::R] = row_levels[x];
+                        pixel[Image::G] = row_levels[x];
+                        pixel[Image::B] = row_levels[x];
+                    }
+                } else if (step.type == FusedStep::LOOKUP_TABLE) {
+                    kernels.lookup_table_row(row, row, width, step.lut);
+                } else if (step.noise_values != nullptr) {
+                    kernels.add_noise_row(row, row, width, step.noise_values + (int64_t) y * width);
+                } else {
+                    // noise of the pixels of the row, at their index in the whole image
+                    const int64_t row_begin = (int64_t) y * width;
+                    generate_gaussian_noise_range(row_noise, row_begin, row_begin + width, step.sigma, step.seed);
+                    kernels.add_noise_row(row, row, width, row_noise);
+                }
+            }
+        }
+    }, progress);
+}
+
+bool LazyImage::Node::isPointOperation() const {
+    return type == GRAY || type == LOOKUP_TABLE || type == NOISE;
+}
+
+LazyImage::LazyImage() {}
+
+LazyImage::LazyImage(std::shared_ptr<Image> image) {
+    if (image == nullptr)
+        return;
+
+    std::shared_ptr<Node> node = std::make_shared<Node>();
+    node->type = Node::SOURCE;
+    node->width = image->getImageWidth();
+    node->height = image->getImageHeight();
+    // keep a copy, the pixels are shared until either image is written
+    node->image = std::make_shared<Image>(*image);
+    _node = node;
+}
+
+LazyImage::LazyImage(std::shared_ptr<const Node> node) : _node(std::move(node)) {}
+
+bool LazyImage::empty() const {
+    return _node == nullptr;
+}
+
+int LazyImage::getImageWidth() const {
+    return _node != nullptr ? _node->width : 0;
+}
+
+int LazyImage::getImageHeight() const {
+    return _node != nullptr ? _node->height : 0;
+}
+
+LazyImage LazyImage::append(Node node) const {
+    if (_node == nullptr)
+        return LazyImage();
+    node.input = _node;
+    node.width = getImageWidth();
+    node.height = getImageHeight();
+    return LazyImage(std::make_shared<const Node>(std::move(node)));
+}
+
+LazyImage LazyImage::gray() const {
+    Node node = {};
+    node.type = Node::GRAY;
+    return append(std::move(node));
+}
+
+LazyImage LazyImage::lookupTable(const uint8_t *lut) const {
+    Node node = {};
+    node.type = Node::LOOKUP_TABLE;
+    std::memcpy(node.lut, lut, sizeof(node.lut));
+    return append(std::move(node));
+}
+
+LazyImage LazyImage::noise(float sigma, uint64_t seed) const {
+    Node node = {};
+    node.type = Node::NOISE;
+    node.sigma = sigma;
+    node.seed = seed;
+    return append(std::move(node));
+}
+
+LazyImage LazyImage::noise(std::shared_ptr<const float[]> values) const {
+    Node node = {};
+    node.type = Node::NOISE;
+    node.noise_values = std::move(values);
+    return append(std::move(node));
+}
+
+LazyImage LazyImage::clamp(uint8_t low, uint8_t high) const {
+    uint8_t lut[256];
+    for (int i = 0; i < 256; ++i)
+        lut[i] = std::clamp<int>(i, low, std::max(low, high));
+    return lookupTable(lut);
+}
+
+LazyImage LazyImage::convolution(int kernel_size, const float *kernel,
+        ConvolutionEdgeHandlingMethod edge_handling_method) const {
+    Node node = {};
+    node.type = Node::CONVOLUTION;
+    node.kernel_size = kernel_size;
+    node.kernel.assign(kernel, kernel + kernel_size * kernel_size);
+    node.edge_handling_method = edge_handling_method;
+    return append(std::move(node));
+}
+
+LazyImage LazyImage::histogramEqualization() const {
+    Node node = {};
+    node.type = Node::HISTOGRAM_EQUALIZATION;
+    return append(std::move(node));
+}
+
+std::shared_ptr<Image> LazyImage::evaluate(Progress *progress) const {
+    if (_node == nullptr)
+        return nullptr;
+    return evaluateNode(_node, progress);
+}
+
+std::shared_ptr<Image> LazyImage::evaluateNode(const std::shared_ptr<const Node> &node, Progress *progress) {
+    if (node->type == Node::SOURCE)
+        return std::make_shared<Image>(*node->image);
+
+    if (node->type == Node::CONVOLUTION || node->type == Node::HISTOGRAM_EQUALIZATION) {
+        // the chain of neighborhood operations and lookup tables ending at the node, from the last one
+        std::vector<const Node *> chain;
+        const Node *base = node.get();
+        while (base->type == Node::CONVOLUTION || base->type == Node::HISTOGRAM_EQUALIZATION ||
+                base->type == Node::LOOKUP_TABLE) {
+            chain.push_back(base);
+            base = base->input.get();
+        }
+
+        // run tile by tile from the input of the chain
+        TilePipeline pipeline;
+        for (auto chain_node = chain.rbegin(); chain_node != chain.rend(); ++chain_node) {
+            if ((*chain_node)->type == Node::CONVOLUTION) {
+                pipeline.addConvolution((*chain_node)->kernel_size, (*chain_node)->kernel.data(),
+                        (*chain_node)->edge_handling_method);
+            } else if ((*chain_node)->type == Node::HISTOGRAM_EQUALIZATION) {
+                pipeline.addHistogramEqualization();
+            } else {
+                pipeline.addLookupTable((*chain_node)->lut);
+            }
+        }
+        const std::shared_ptr<Image> input = evaluateNode(chain.back()->input, progress);
+        if (input == nullptr)
+            return nullptr;
+        return pipeline.run(input, progress);
+    }
+
+    // the run of point operations ending at the node, from the first one
+    std::vector<const Node *> run;
+    const Node *base = node.get();
+    while (base->isPointOperation()) {
+        run.push_back(base);
+        base = base->input.get();
+    }
+    std::reverse(run.begin(), run.end());
+
+    std::vector<FusedStep> steps;
+    for (const Node *point_node : run) {
+        if (point_node->type == Node::LOOKUP_TABLE && !steps.empty() && steps.back().type == FusedStep::LOOKUP_TABLE) {
+            FusedStep &previous = steps.back();
+            for (int i = 0; i < 256; ++i)
+                previous.lut[i] = point_node->lut[previous.lut[i]];
+            continue;
+        }
+
+        FusedStep step = {};
+        if (point_node->type == Node::GRAY) {
+            step.type = FusedStep::GRAY;
+        } else if (point_node->type == Node::LOOKUP_TABLE) {
+            step.type = FusedStep::LOOKUP_TABLE;
+            std::memcpy(step.lut, point_node->lut, sizeof(step.lut));
+        } else {
+            step.type = FusedStep::NOISE;
+            step.sigma = point_node->sigma;
+            step.seed = point_node->seed;
+            step.noise_values = point_node->noise_values.get();
+        }
+        steps.push_back(step);
+    }
+
+    // a source is read into a new image, the result of an operation is a new image worked on in place
+    std::shared_ptr<Image> result;
+    if (base->type == Node::SOURCE) {
+        result = std::make_shared<Image>(base->width, base->height, Image::INIT_UNINITIALIZED);
+        run_fused_steps(std::as_const(*base->image).view(), result->view(), steps, progress);
+    } else {
+        result = evaluateNode(run.front()->input, progress);
+        if (result == nullptr)
+            return nullptr;
+        const ImageView view = result->view();
+        run_fused_steps(view, view, steps, progress);
+    }
+    return is_canceled(progress) ? nullptr : result;
+}
@@ -0,0 +1,87 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_LAZY_IMAGE_H__
+#define ADVANCED_IMAGE_PROCESSOR_LAZY_IMAGE_H__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "algorithms.h"
+#include "image.h"
+#include "progress.h"
+
+/*
+ * Image defined by the operations producing it, computed on evaluate().
+ *
+ * Each operation returns a new lazy image recording the operation as a node
+ * on top of its input, so recipes can branch from any step. Nothing is
+ * computed until evaluate() is called, typically when the result is
+ * displayed or saved.
+ *
+ * Consecutive point operations (gray conversion, lookup tables, noise,
+ * clamping) are fused: they run one after another on each row while it is
+ * in the cache, in a single pass from the input to the output image, and
+ * consecutive lookup tables and clamps are folded into one table.
+ * Consecutive neighborhood operations (convolution, histogram equalization)
+ * and the lookup tables between them run as a TilePipeline, tile by tile,
+ * from their evaluated input.
+ *
+ * Results are the same as running the operations one after another.
+ * The point operations keep the alpha channel.
+ */
+class LazyImage {
+public:
+
+    LazyImage();
+    LazyImage(std::shared_ptr<Image> image);
+
+    bool empty() const;
+    int getImageWidth() const;
+    int getImageHeight() const;
+
+    // point operations
+    LazyImage gray() const;
+    LazyImage lookupTable(const uint8_t *lut) const;
+    // same noise as generate_gaussian_noise with the seed, one value per pixel
+    LazyImage noise(float sigma, uint64_t seed=0) const;
+    // noise already generated, one value per pixel in row order like add_noise
+    LazyImage noise(std::shared_ptr<const float[]> values) const;
+    LazyImage clamp(uint8_t low, uint8_t high) const;
+
+    // neighborhood operations
+    LazyImage convolution(int kernel_size, const float *kernel,
+            ConvolutionEdgeHandlingMethod edge_handling_method=ConvolutionEdgeHandlingMethod::EXTEND) const;
+    LazyImage histogramEqualization() const;
+
+    // nullptr when canceled
+    std::shared_ptr<Image> evaluate(Progress *progress=nullptr) const;
+
+private:
+    struct Node {
+        enum Type { SOURCE, GRAY, LOOKUP_TABLE, NOISE, CONVOLUTION, HISTOGRAM_EQUALIZATION };
+
+        Type type;
+        std::shared_ptr<const Node> input;
+        int width;
+        int height;
+
+        std::shared_ptr<Image> image;
+        uint8_t lut[256];
+        float sigma;
+        uint64_t seed;
+        std::shared_ptr<const float[]> noise_values;
+        int kernel_size;
+        std::vector<float> kernel;
+        ConvolutionEdgeHandlingMethod edge_handling_method;
+
+        bool isPointOperation() const;
+    };
+
+    explicit LazyImage(std::shared_ptr<const Node> node);
+    LazyImage append(Node node) const;
+
+    static std::shared_ptr<Image> evaluateNode(const std::shared_ptr<const Node> &node, Progress *progress);
+
+    std::shared_ptr<const Node> _node;
+};
+
+#endif // ADVANCED_IMAGE_PROCESSOR_LAZY_IMAGE_H__
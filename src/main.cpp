@@ -1,12 +1,18 @@
 #include <cmath>
+#include <cstring>
 #include <memory>
 
+#include "batch.h"
 #include "handlers.h"
 #include "image.h"
 #include "view.h"
 
 int main(int argc, const char **argv) {
 
+    // batch processing from the command line, without a window
+    if (argc >= 2 && std::strcmp(argv[1], "batch") == 0)
+        return run_batch_command(argc - 2, argv + 2);
+
     // init gui
     bool result = view_init();
     if (!result) {
@@ -28,7 +34,6 @@ int main(int argc, const char **argv) {
             formula_image->pixel(x, y)[Image::B] = int(atan(x) * 73) % 143 + y * 46 % 86 - y * x * 54 % 31;
         }
     }
-    formula_image->loadToTexture();
     display_image_helper(formula_image, "default math formula image");
 
     // start window render loop
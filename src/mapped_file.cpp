@@ -0,0 +1,196 @@
+#include "mapped_file.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif // _WIN32
+
+// unique file name for a temporary file in the directory (or the system temporary directory)
+static std::filesystem::path make_temporary_path(const std::string &directory) {
+    static std::atomic<int> counter = 0;
+    const std::filesystem::path base = directory.empty() ? std::filesystem::temp_directory_path() : std::filesystem::path(directory);
+#ifdef _WIN32
+    const unsigned long process_id = GetCurrentProcessId();
+#else
+    const unsigned long process_id = getpid();
+#endif // _WIN32
+    return base / ("aip-spill-" + std::to_string(process_id) + "-" + std::to_string(++counter) + ".raw");
+}
+
+#ifdef _WIN32
+
+static std::wstring utf8_to_wide(const std::string &text) {
+    const int length = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, nullptr, 0);
+    std::wstring result(length, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, result.data(), length);
+    result.resize(length > 0 ? length - 1 : 0);
+    return result;
+}
+
+MappedFile::MappedFile() :
+        _data(nullptr), _size(0), _writable(false), _file_handle(INVALID_HANDLE_VALUE), _mapping_handle(nullptr) {}
+
+bool MappedFile::open(const std::string &filepath, Mode mode, std::size_t size) {
+    close();
+
+    _writable = mode != MODE_READ_ONLY;
+    const DWORD access = _writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+    DWORD creation = OPEN_EXISTING;
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    std::wstring path;
+    if (mode == MODE_TEMPORARY) {
+        path = make_temporary_path(filepath).wstring();
+        creation = CREATE_NEW;
+        flags = FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE;
+    } else {
+        path = utf8_to_wide(filepath);
+        if (mode == MODE_CREATE)
+            creation = CREATE_ALWAYS;
+    }
+
+    _file_handle = CreateFileW(path.c_str(), access, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, creation, flags, nullptr);
+    if (_file_handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    if (mode == MODE_READ_ONLY || mode == MODE_READ_WRITE) {
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(_file_handle, &file_size)) {
+            close();
+            return false;
+        }
+        size = (std::size_t) file_size.QuadPart;
+    }
+    if (size == 0) {
+        close();
+        return false;
+    }
+
+    // mapping a file larger than its size extends it
+    const DWORD protect = _writable ? PAGE_READWRITE : PAGE_READONLY;
+    _mapping_handle = CreateFileMappingW(_file_handle, nullptr, protect,
+            (DWORD) ((uint64_t) size >> 32), (DWORD) (size & 0xffffffffu), nullptr);
+    if (_mapping_handle == nullptr) {
+        close();
+        return false;
+    }
+
+    _data = static_cast<uint8_t *>(MapViewOfFile(_mapping_handle, _writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size));
+    if (_data == nullptr) {
+        close();
+        return false;
+    }
+    _size = size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (_data != nullptr)
+        UnmapViewOfFile(_data);
+    if (_mapping_handle != nullptr)
+        CloseHandle(_mapping_handle);
+    if (_file_handle != INVALID_HANDLE_VALUE)
+        CloseHandle(_file_handle);
+    _data = nullptr;
+    _size = 0;
+    _writable = false;
+    _file_handle = INVALID_HANDLE_VALUE;
+    _mapping_handle = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile() : _data(nullptr), _size(0), _writable(false), _fd(-1) {}
+
+bool MappedFile::open(const std::string &filepath, Mode mode, std::size_t size) {
+    close();
+
+    _writable = mode != MODE_READ_ONLY;
+    if (mode == MODE_TEMPORARY) {
+        // the name is removed right away, the file lives until it's unmapped
+        const std::string path = make_temporary_path(filepath).string();
+        _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (_fd >= 0)
+            unlink(path.c_str());
+    } else if (mode == MODE_CREATE) {
+        _fd = ::open(filepath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    } else {
+        _fd = ::open(filepath.c_str(), _writable ? O_RDWR : O_RDONLY);
+    }
+    if (_fd < 0)
+        return false;
+
+    if (mode == MODE_CREATE || mode == MODE_TEMPORARY) {
+        if (ftruncate(_fd, (off_t) size) != 0) {
+            close();
+            return false;
+        }
+    } else {
+        struct stat file_stat;
+        if (fstat(_fd, &file_stat) != 0) {
+            close();
+            return false;
+        }
+        size = (std::size_t) file_stat.st_size;
+    }
+    if (size == 0) {
+        close();
+        return false;
+    }
+
+    void *data = mmap(nullptr, size, _writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, _fd, 0);
+    if (data == MAP_FAILED) {
+        close();
+        return false;
+    }
+    _data = static_cast<uint8_t *>(data);
+    _size = size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (_data != nullptr)
+        munmap(_data, _size);
+    if (_fd >= 0)
+        ::close(_fd);
+    _data = nullptr;
+    _size = 0;
+    _writable = false;
+    _fd = -1;
+}
+
+#endif // _WIN32
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::good() const {
+    return _data != nullptr;
+}
+
+bool MappedFile::isWritable() const {
+    return _writable;
+}
+
+uint8_t *MappedFile::data() {
+    return _data;
+}
+
+const uint8_t *MappedFile::data() const {
+    return _data;
+}
+
+std::size_t MappedFile::size() const {
+    return _size;
+}
@@ -0,0 +1,53 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_MAPPED_FILE_H__
+#define ADVANCED_IMAGE_PROCESSOR_MAPPED_FILE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * A file mapped into memory.
+ *
+ * The OS pages the content in on first access, so a mapping costs no
+ * resident memory until it is touched. Writes to a writable mapping go to
+ * the file.
+ */
+class MappedFile {
+public:
+
+    enum Mode {
+        MODE_READ_ONLY,
+        MODE_READ_WRITE,   // existing file
+        MODE_CREATE,       // new or truncated file of the given size
+        MODE_TEMPORARY     // new file in the directory, deleted when unmapped
+    };
+
+    MappedFile();
+    MappedFile(const MappedFile &other) = delete;
+    ~MappedFile();
+
+    MappedFile &operator=(const MappedFile &other) = delete;
+
+    // size is only used by MODE_CREATE and MODE_TEMPORARY, MODE_TEMPORARY takes a directory instead of a file path
+    bool open(const std::string &filepath, Mode mode, std::size_t size=0);
+    void close();
+    bool good() const;
+    bool isWritable() const;
+
+    uint8_t *data();
+    const uint8_t *data() const;
+    std::size_t size() const;
+
+private:
+    uint8_t *_data;
+    std::size_t _size;
+    bool _writable;
+#ifdef _WIN32
+    void *_file_handle;
+    void *_mapping_handle;
+#else
+    int _fd;
+#endif // _WIN32
+};
+
+#endif // ADVANCED_IMAGE_PROCESSOR_MAPPED_FILE_H__
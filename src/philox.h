@@ -0,0 +1,50 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_PHILOX_H__
+#define ADVANCED_IMAGE_PROCESSOR_PHILOX_H__
+
+#include <array>
+#include <cstdint>
+
+/*
+ * Philox4x32-10 counter-based random number generator (Salmon et al.,
+ * "Parallel Random Numbers: As Easy as 1, 2, 3", SC11).
+ *
+ * The output is a pure function of a 128-bit counter and a 64-bit key, so
+ * the numbers for element i under a seed can be computed by any thread in
+ * any order, and are the same whatever the number of threads.
+ */
+
+using PhiloxCounter = std::array<uint32_t, 4>;
+using PhiloxKey = std::array<uint32_t, 2>;
+
+inline PhiloxCounter philox4x32(PhiloxCounter counter, PhiloxKey key) {
+    constexpr uint32_t multiplier_0 = 0xD2511F53;
+    constexpr uint32_t multiplier_1 = 0xCD9E8D57;
+    constexpr uint32_t weyl_0 = 0x9E3779B9;
+    constexpr uint32_t weyl_1 = 0xBB67AE85;
+
+    for (int round = 0; round < 10; ++round) {
+        const uint64_t product_0 = (uint64_t) multiplier_0 * counter[0];
+        const uint64_t product_1 = (uint64_t) multiplier_1 * counter[2];
+        counter = {
+            (uint32_t) (product_1 >> 32) ^ counter[1] ^ key[0],
+            (uint32_t) product_1,
+            (uint32_t) (product_0 >> 32) ^ counter[3] ^ key[1],
+            (uint32_t) product_0
+        };
+        key[0] += weyl_0;
+        key[1] += weyl_1;
+    }
+    return counter;
+}
+
+// random words of element index under the seed
+inline PhiloxCounter philox_random(uint64_t seed, uint64_t index) {
+    return philox4x32({(uint32_t) index, (uint32_t) (index >> 32), 0, 0}, {(uint32_t) seed, (uint32_t) (seed >> 32)});
+}
+
+// uniform double in [0, 1) from 53 random bits of two words
+inline double philox_uniform(uint32_t high, uint32_t low) {
+    return (double) ((((uint64_t) high << 32) | low) >> 11) * 0x1.0p-53;
+}
+
+#endif // ADVANCED_IMAGE_PROCESSOR_PHILOX_H__
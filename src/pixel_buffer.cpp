@@ -0,0 +1,162 @@
+#include "pixel_buffer.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#include "mapped_file.h"
+
+static constexpr std::size_t default_pool_capacity = 512 * 1024 * 1024;
+static constexpr std::size_t min_size_class = 4096;
+
+PixelBufferPool &PixelBufferPool::instance() {
+    // never destroyed, images in static storage may release their pixels after main() returns
+    static PixelBufferPool *pool = new PixelBufferPool();
+    return *pool;
+}
+
+PixelBufferPool::PixelBufferPool() : _cached_bytes(0), _capacity(default_pool_capacity) {}
+
+PixelBufferPool::~PixelBufferPool() {
+    trimTo(0);
+}
+
+std::size_t PixelBufferPool::sizeClass(std::size_t size_in_bytes) {
+    if (size_in_bytes <= min_size_class)
+        return min_size_class;
+
+    // four classes per power of two, so at most 25% of a block is wasted
+    const std::size_t power = std::bit_floor(size_in_bytes);
+    const std::size_t step = power / 4;
+    return (size_in_bytes + step - 1) / step * step;
+}
+
+uint8_t *PixelBufferPool::allocate(std::size_t size_in_bytes) {
+    const std::size_t block_size = sizeClass(size_in_bytes);
+
+    // reuse a freed block of the same size class
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _free_blocks.find(block_size);
+        if (it != _free_blocks.end() && !it->second.empty()) {
+            uint8_t *block = it->second.back();
+            it->second.pop_back();
+            _cached_bytes -= block_size;
+            return block;
+        }
+    }
+
+    return static_cast<uint8_t *>(::operator new(block_size, std::align_val_t(alignment)));
+}
+
+void PixelBufferPool::deallocate(uint8_t *data, std::size_t size_in_bytes) {
+    if (data == nullptr)
+        return;
+
+    const std::size_t block_size = sizeClass(size_in_bytes);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_cached_bytes + block_size <= _capacity) {
+            _free_blocks[block_size].push_back(data);
+            _cached_bytes += block_size;
+            return;
+        }
+    }
+
+    ::operator delete(data, std::align_val_t(alignment));
+}
+
+void PixelBufferPool::setCapacity(std::size_t capacity_in_bytes) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _capacity = capacity_in_bytes;
+    }
+    trimTo(capacity_in_bytes);
+}
+
+std::size_t PixelBufferPool::getCapacity() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _capacity;
+}
+
+std::size_t PixelBufferPool::getCachedBytes() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _cached_bytes;
+}
+
+void PixelBufferPool::trim() {
+    trimTo(0);
+}
+
+void PixelBufferPool::trimTo(std::size_t capacity_in_bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // free the largest blocks first
+    for (auto it = _free_blocks.rbegin(); it != _free_blocks.rend() && _cached_bytes > capacity_in_bytes; ++it) {
+        std::vector<uint8_t *> &blocks = it->second;
+        while (!blocks.empty() && _cached_bytes > capacity_in_bytes) {
+            ::operator delete(blocks.back(), std::align_val_t(alignment));
+            blocks.pop_back();
+            _cached_bytes -= it->first;
+        }
+    }
+}
+
+PixelBuffer::PixelBuffer() : _data(nullptr), _size(0) {}
+
+PixelBuffer::PixelBuffer(std::size_t size_in_bytes) :
+        _data(PixelBufferPool::instance().allocate(size_in_bytes)), _size(size_in_bytes) {}
+
+PixelBuffer::PixelBuffer(std::unique_ptr<MappedFile> mapping, std::size_t offset, std::size_t size_in_bytes) :
+        _data(mapping->data() + offset), _size(size_in_bytes), _mapping(std::move(mapping)) {}
+
+PixelBuffer::PixelBuffer(PixelBuffer &&other) noexcept :
+        _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0)),
+        _mapping(std::move(other._mapping)) {}
+
+PixelBuffer::~PixelBuffer() {
+    release();
+}
+
+PixelBuffer &PixelBuffer::operator=(PixelBuffer &&other) noexcept {
+    if (this != &other) {
+        release();
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+        _mapping = std::move(other._mapping);
+    }
+    return *this;
+}
+
+void PixelBuffer::release() {
+    if (_mapping != nullptr)
+        _mapping.reset();
+    else if (_data != nullptr)
+        PixelBufferPool::instance().deallocate(_data, _size);
+    _data = nullptr;
+    _size = 0;
+}
+
+uint8_t *PixelBuffer::data() {
+    return _data;
+}
+
+const uint8_t *PixelBuffer::data() const {
+    return _data;
+}
+
+std::size_t PixelBuffer::size() const {
+    return _size;
+}
+
+bool PixelBuffer::isMapped() const {
+    return _mapping != nullptr;
+}
+
+bool PixelBuffer::isWritable() const {
+    return _mapping == nullptr || _mapping->isWritable();
+}
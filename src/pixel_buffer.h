@@ -0,0 +1,86 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_PIXEL_BUFFER_H__
+#define ADVANCED_IMAGE_PROCESSOR_PIXEL_BUFFER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "mapped_file.h"
+
+/*
+ * Pool of 64-byte aligned pixel memory.
+ *
+ * Requests are rounded up to a size class and freed blocks are kept per size
+ * class, so images of similar sizes reuse memory which is already paged in
+ * instead of faulting fresh pages. Cached blocks beyond the capacity are
+ * returned to the system.
+ */
+class PixelBufferPool {
+public:
+
+    static constexpr std::size_t alignment = 64;
+
+    static PixelBufferPool &instance();
+
+    PixelBufferPool(const PixelBufferPool &other) = delete;
+    ~PixelBufferPool();
+
+    uint8_t *allocate(std::size_t size_in_bytes);
+    void deallocate(uint8_t *data, std::size_t size_in_bytes);
+
+    void setCapacity(std::size_t capacity_in_bytes);
+    std::size_t getCapacity() const;
+    std::size_t getCachedBytes() const;
+    void trim();
+
+    static std::size_t sizeClass(std::size_t size_in_bytes);
+
+private:
+    PixelBufferPool();
+    void trimTo(std::size_t capacity_in_bytes);
+
+    mutable std::mutex _mutex;
+    std::map<std::size_t, std::vector<uint8_t *>> _free_blocks;
+    std::size_t _cached_bytes;
+    std::size_t _capacity;
+};
+
+/*
+ * Pixel memory owned by a single object: an aligned block recycled by the
+ * pool, or a part of a file mapping which is unmapped on release.
+ */
+class PixelBuffer {
+public:
+
+    PixelBuffer();
+    explicit PixelBuffer(std::size_t size_in_bytes);
+    PixelBuffer(std::unique_ptr<MappedFile> mapping, std::size_t offset, std::size_t size_in_bytes);
+    PixelBuffer(const PixelBuffer &other) = delete;
+    PixelBuffer(PixelBuffer &&other) noexcept;
+    ~PixelBuffer();
+
+    PixelBuffer &operator=(const PixelBuffer &other) = delete;
+    PixelBuffer &operator=(PixelBuffer &&other) noexcept;
+
+    void release();
+    uint8_t *data();
+    const uint8_t *data() const;
+    std::size_t size() const;
+    bool isMapped() const;
+    bool isWritable() const;
+
+    // hash of the pixels while images share the buffer, 0 otherwise; only debug builds set it (see Image)
+    // but it is always there, so code built with and without NDEBUG agrees on the layout
+    std::atomic<uint64_t> shared_hash = 0;
+
+private:
+    uint8_t *_data;
+    std::size_t _size;
+    std::unique_ptr<MappedFile> _mapping;
+};
+
+#endif // ADVANCED_IMAGE_PROCESSOR_PIXEL_BUFFER_H__
@@ -0,0 +1,894 @@
+#include "pixel_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <stb_image_resize.h>
+
+#include "cpu_features.h"
+#include "utility.h"
+
+#ifdef AIP_X86_KERNELS
+#include <immintrin.h>
+#endif // AIP_X86_KERNELS
+
+/*
+ * Generic kernels, portable C++. The x86 kernels fall back to them for the
+ * pixels at the end of rows that don't fill a vector, and share the ones
+ * with no worthwhile vector form (byte lookups and histograms).
+ */
+
+static void gray_row_generic(const uint8_t *pixels, uint8_t *out_levels, int width) {
+    // round(sum / 3) for the sum of three levels, in integers
+    for (int x = 0; x < width; ++x) {
+        const uint8_t *pixel = pixels + x * 4;
+        out_levels[x] = (pixel[0] + pixel[1] + pixel[2] + 1) / 3;
+    }
+}
+
+static void count_levels_generic(const uint8_t *levels, int count, int *level_count) {
+    for (int i = 0; i < count; ++i)
+        ++level_count[levels[i]];
+}
+
+static void lookup_table_row_generic(const uint8_t *pixels, uint8_t *out_pixels, int width, const uint8_t *lut) {
+    for (int x = 0; x < width; ++x) {
+        const uint8_t *pixel = pixels + x * 4;
+        uint8_t *out_pixel = out_pixels + x * 4;
+        out_pixel[0] = lut[pixel[0]];
+        out_pixel[1] = lut[pixel[1]];
+        out_pixel[2] = lut[pixel[2]];
+        out_pixel[3] = pixel[3];
+    }
+}
+
+static void add_noise_row_generic(const uint8_t *pixels, uint8_t *out_pixels, int width, const float *noise) {
+    for (int x = 0; x < width; ++x) {
+        const uint8_t *pixel = pixels + x * 4;
+        uint8_t *out_pixel = out_pixels + x * 4;
+        for (int c = 0; c < 3; ++c)
+            out_pixel[c] = clamp(pixel[c] + 255 * noise[x], 0.f, 255.f);
+        out_pixel[3] = pixel[3];
+    }
+}
+
+/*
+ * The 2D convolutions are templates on the kernel size K. The common sizes
+ * 3, 5 and 7 are compiled with kernel_size known, so the loops over the
+ * taps unroll and their weights can stay in registers; K = 0 is the
+ * fallback taking kernel_size at run time.
+ */
+#define AIP_CONVOLVE_SIZED(function, kernel_size, ...) \
+    switch (kernel_size) { \
+    case 3: \
+        return function<3>(__VA_ARGS__); \
+    case 5: \
+        return function<5>(__VA_ARGS__); \
+    case 7: \
+        return function<7>(__VA_ARGS__); \
+    default: \
+        return function<0>(__VA_ARGS__); \
+    }
+
+template <int K>
+static void convolve_pixel(const uint8_t *const *rows, int kernel_size, const float *weights,
+        const uint8_t *alpha_pixels, uint8_t *out_pixels, int x) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    float sum[3] = {};
+    const float *weight = weights;
+    for (int i = 0; i < kernel_size; ++i) {
+        const uint8_t *pixel = rows[i] + x * 4;
+        for (int j = 0; j < kernel_size; ++j, ++weight, pixel += 4) {
+            for (int c = 0; c < 3; ++c)
+                sum[c] += *weight * pixel[c];
+        }
+    }
+
+    for (int c = 0; c < 3; ++c)
+        out_pixels[x * 4 + c] = clamp(std::round(sum[c]), 0.f, 255.f);
+    out_pixels[x * 4 + 3] = alpha_pixels[x * 4 + 3];
+}
+
+template <int K>
+static void convolve_row_generic_sized(const uint8_t *const *rows, int kernel_size, const float *weights,
+        const uint8_t *alpha_pixels, uint8_t *out_pixels, int width) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    for (int x = 0; x < width; ++x)
+        convolve_pixel<K>(rows, kernel_size, weights, alpha_pixels, out_pixels, x);
+}
+
+static void convolve_row_generic(const uint8_t *const *rows, int kernel_size, const float *weights,
+        const uint8_t *alpha_pixels, uint8_t *out_pixels, int width) {
+    AIP_CONVOLVE_SIZED(convolve_row_generic_sized, kernel_size,
+            rows, kernel_size, weights, alpha_pixels, out_pixels, width);
+}
+
+template <int K>
+static void convolve_gray_pixel(const uint8_t *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_levels, int x) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    float sum = 0.f;
+    const float *weight = weights;
+    for (int i = 0; i < kernel_size; ++i) {
+        const uint8_t *level = rows[i] + x;
+        for (int j = 0; j < kernel_size; ++j, ++weight)
+            sum += *weight * level[j];
+    }
+    out_levels[x] = clamp(std::round(sum), 0.f, 255.f);
+}
+
+template <int K>
+static void convolve_gray_row_generic_sized(const uint8_t *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_levels, int width) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    for (int x = 0; x < width; ++x)
+        convolve_gray_pixel<K>(rows, kernel_size, weights, out_levels, x);
+}
+
+static void convolve_gray_row_generic(const uint8_t *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_levels, int width) {
+    AIP_CONVOLVE_SIZED(convolve_gray_row_generic_sized, kernel_size,
+            rows, kernel_size, weights, out_levels, width);
+}
+
+static void convolve_horizontal_generic(const uint8_t *values, int step, int kernel_size, const float *weights,
+        float *out_sums, int count) {
+    for (int i = 0; i < count; ++i) {
+        float sum = 0.f;
+        for (int j = 0; j < kernel_size; ++j)
+            sum += weights[j] * values[i + j * step];
+        out_sums[i] = sum;
+    }
+}
+
+// the values [begin, end) of a vertical pass, as the rows can't be offset
+static void convolve_vertical_generic_tail(const float *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_values, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+        float sum = 0.f;
+        for (int j = 0; j < kernel_size; ++j)
+            sum += weights[j] * rows[j][i];
+        out_values[i] = clamp(std::round(sum), 0.f, 255.f);
+    }
+}
+
+static void convolve_vertical_generic(const float *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_values, int count) {
+    convolve_vertical_generic_tail(rows, kernel_size, weights, out_values, 0, count);
+}
+
+static bool resize_generic(const uint8_t *pixels, int width, int height, int stride,
+        uint8_t *out_pixels, int out_width, int out_height, int out_stride, int channels) {
+    return stbir_resize_uint8(pixels, width, height, stride, out_pixels, out_width, out_height, out_stride, channels);
+}
+
+static bool resize_float_generic(const float *pixels, int width, int height, int stride,
+        float *out_pixels, int out_width, int out_height, int out_stride, int channels) {
+    return stbir_resize_float(pixels, width, height, stride, out_pixels, out_width, out_height, out_stride, channels);
+}
+
+#ifdef AIP_X86_KERNELS
+
+/*
+ * x86 kernels. Each function is built for its level with a target
+ * attribute, the rest of the program for the baseline.
+ *
+ * Sums are made in the order of the generic kernels with separate
+ * multiplies and adds (the build disables contraction into FMA), and
+ * round(x) clamped to [0, 255] is computed as the truncation of x clamped
+ * to [-1, 256], moved away from zero when the fraction is at least a half.
+ */
+
+// resize_kernels.cpp, built once per level
+bool resize_sse2(const uint8_t *pixels, int width, int height, int stride,
+        uint8_t *out_pixels, int out_width, int out_height, int out_stride, int channels);
+bool resize_float_sse2(const float *pixels, int width, int height, int stride,
+        float *out_pixels, int out_width, int out_height, int out_stride, int channels);
+bool resize_avx2(const uint8_t *pixels, int width, int height, int stride,
+        uint8_t *out_pixels, int out_width, int out_height, int out_stride, int channels);
+bool resize_float_avx2(const float *pixels, int width, int height, int stride,
+        float *out_pixels, int out_width, int out_height, int out_stride, int channels);
+bool resize_avx512(const uint8_t *pixels, int width, int height, int stride,
+        uint8_t *out_pixels, int out_width, int out_height, int out_stride, int channels);
+bool resize_float_avx512(const float *pixels, int width, int height, int stride,
+        float *out_pixels, int out_width, int out_height, int out_stride, int channels);
+
+#define AIP_TARGET_SSE2 __attribute__((target("sse2")))
+#define AIP_TARGET_AVX2 __attribute__((target("avx2")))
+#define AIP_TARGET_AVX512 __attribute__((target("avx512f")))
+
+/* SSE2, 4 floats: one RGBA pixel or 4 gray levels */
+
+AIP_TARGET_SSE2 static inline __m128i round_clamped_sse2(__m128 x) {
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-1.f)), _mm_set1_ps(256.f));
+    const __m128i truncated = _mm_cvttps_epi32(x);
+    const __m128 fraction = _mm_sub_ps(x, _mm_cvtepi32_ps(truncated));
+    const __m128i up = _mm_castps_si128(_mm_cmpge_ps(fraction, _mm_set1_ps(.5f)));
+    const __m128i down = _mm_castps_si128(_mm_cmple_ps(fraction, _mm_set1_ps(-.5f)));
+    return _mm_add_epi32(_mm_sub_epi32(truncated, up), down);
+}
+
+// 4 pixels of 32-bit channels to bytes, saturated to [0, 255]
+AIP_TARGET_SSE2 static inline __m128i pack_pixels_sse2(__m128i p0, __m128i p1, __m128i p2, __m128i p3) {
+    return _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+}
+
+// color bytes of pixels with the alpha bytes of alpha_pixels
+AIP_TARGET_SSE2 static inline __m128i merge_alpha_sse2(__m128i pixels, __m128i alpha_pixels) {
+    const __m128i alpha_mask = _mm_set1_epi32((int) 0xFF000000);
+    return _mm_or_si128(_mm_andnot_si128(alpha_mask, pixels), _mm_and_si128(alpha_mask, alpha_pixels));
+}
+
+AIP_TARGET_SSE2 static void gray_row_sse2(const uint8_t *pixels, uint8_t *out_levels, int width) {
+    // (sum + 1) / 3 as the high half of (sum + 1) * 0xAAAB shifted by one more bit
+    const __m128i byte_mask = _mm_set1_epi32(0xFF);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i magic = _mm_set1_epi32(0xAAAB);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i levels[4];
+        for (int k = 0; k < 4; ++k) {
+            const __m128i p = _mm_loadu_si128((const __m128i *) (pixels + (x + k * 4) * 4));
+            __m128i sum = _mm_add_epi32(_mm_and_si128(p, byte_mask), _mm_and_si128(_mm_srli_epi32(p, 8), byte_mask));
+            sum = _mm_add_epi32(sum, _mm_and_si128(_mm_srli_epi32(p, 16), byte_mask));
+            levels[k] = _mm_srli_epi32(_mm_mulhi_epu16(_mm_add_epi32(sum, one), magic), 1);
+        }
+        _mm_storeu_si128((__m128i *) (out_levels + x), pack_pixels_sse2(levels[0], levels[1], levels[2], levels[3]));
+    }
+    gray_row_generic(pixels + x * 4, out_levels + x, width - x);
+}
+
+AIP_TARGET_SSE2 static void add_noise_row_sse2(const uint8_t *pixels, uint8_t *out_pixels, int width, const float *noise) {
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i p = _mm_loadu_si128((const __m128i *) (pixels + x * 4));
+        const __m128i low = _mm_unpacklo_epi8(p, zero);
+        const __m128i high = _mm_unpackhi_epi8(p, zero);
+        const __m128i channels[4] = {
+            _mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero),
+            _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero)
+        };
+
+        __m128i results[4];
+        for (int k = 0; k < 4; ++k) {
+            const __m128 value = _mm_add_ps(_mm_cvtepi32_ps(channels[k]),
+                    _mm_mul_ps(_mm_set1_ps(255.f), _mm_set1_ps(noise[x + k])));
+            results[k] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(255.f)));
+        }
+        const __m128i out = pack_pixels_sse2(results[0], results[1], results[2], results[3]);
+        _mm_storeu_si128((__m128i *) (out_pixels + x * 4), merge_alpha_sse2(out, p));
+    }
+    add_noise_row_generic(pixels + x * 4, out_pixels + x * 4, width - x, noise + x);
+}
+
+AIP_TARGET_SSE2 static inline __m128 load_pixel_sse2(const uint8_t *pixel) {
+    int32_t bytes;
+    std::memcpy(&bytes, pixel, sizeof(bytes));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+    return _mm_cvtepi32_ps(p);
+}
+
+// color channels of a pixel with the alpha of alpha_pixel, from 4 rounded 32-bit channels
+AIP_TARGET_SSE2 static inline void store_pixel_sse2(__m128i p, const uint8_t *alpha_pixel, uint8_t *out_pixel) {
+    const int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(p, p), p));
+    std::memcpy(out_pixel, &bytes, 3);
+    out_pixel[3] = alpha_pixel[3];
+}
+
+// 4 gray levels from their 32-bit rounded values
+AIP_TARGET_SSE2 static inline void store_levels_sse2(__m128i levels, uint8_t *out_levels) {
+    const int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(levels, levels), levels));
+    std::memcpy(out_levels, &bytes, 4);
+}
+
+/*
+ * The pixels after the last whole block of a row, and the short rows at
+ * the edges of a convolution, take one vector per pixel (per 4 gray
+ * levels) instead of the scalar loop.
+ */
+template <int K>
+AIP_TARGET_SSE2 static void convolve_pixel_sse2(const uint8_t *const *rows, int kernel_size, const float *weights,
+        const uint8_t *alpha_pixels, uint8_t *out_pixels, int x) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    __m128 sum = _mm_setzero_ps();
+    const float *weight = weights;
+    for (int i = 0; i < kernel_size; ++i) {
+        const uint8_t *pixel = rows[i] + x * 4;
+        for (int j = 0; j < kernel_size; ++j, ++weight, pixel += 4)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(*weight), load_pixel_sse2(pixel)));
+    }
+    store_pixel_sse2(round_clamped_sse2(sum), alpha_pixels + x * 4, out_pixels + x * 4);
+}
+
+template <int K>
+AIP_TARGET_SSE2 static void convolve_gray_levels_sse2(const uint8_t *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_levels, int x) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    __m128 sum = _mm_setzero_ps();
+    const float *weight = weights;
+    for (int i = 0; i < kernel_size; ++i) {
+        const uint8_t *level = rows[i] + x;
+        for (int j = 0; j < kernel_size; ++j, ++weight)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(*weight), load_pixel_sse2(level + j)));
+    }
+    store_levels_sse2(round_clamped_sse2(sum), out_levels + x);
+}
+
+template <int K>
+AIP_TARGET_SSE2 static void convolve_row_sse2_sized(const uint8_t *const *rows, int kernel_size, const float *weights,
+        const uint8_t *alpha_pixels, uint8_t *out_pixels, int width) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128 sums[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+        const float *weight = weights;
+        for (int i = 0; i < kernel_size; ++i) {
+            const uint8_t *pixel = rows[i] + x * 4;
+            for (int j = 0; j < kernel_size; ++j, ++weight, pixel += 4) {
+                const __m128 w = _mm_set1_ps(*weight);
+                for (int k = 0; k < 4; ++k)
+                    sums[k] = _mm_add_ps(sums[k], _mm_mul_ps(w, load_pixel_sse2(pixel + k * 4)));
+            }
+        }
+
+        const __m128i out = pack_pixels_sse2(round_clamped_sse2(sums[0]), round_clamped_sse2(sums[1]),
+                round_clamped_sse2(sums[2]), round_clamped_sse2(sums[3]));
+        const __m128i alpha = _mm_loadu_si128((const __m128i *) (alpha_pixels + x * 4));
+        _mm_storeu_si128((__m128i *) (out_pixels + x * 4), merge_alpha_sse2(out, alpha));
+    }
+    for (; x < width; ++x)
+        convolve_pixel_sse2<K>(rows, kernel_size, weights, alpha_pixels, out_pixels, x);
+}
+
+AIP_TARGET_SSE2 static void convolve_row_sse2(const uint8_t *const *rows, int kernel_size, const float *weights,
+        const uint8_t *alpha_pixels, uint8_t *out_pixels, int width) {
+    AIP_CONVOLVE_SIZED(convolve_row_sse2_sized, kernel_size,
+            rows, kernel_size, weights, alpha_pixels, out_pixels, width);
+}
+
+template <int K>
+AIP_TARGET_SSE2 static void convolve_gray_row_sse2_sized(const uint8_t *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_levels, int width) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128 sums[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+        const float *weight = weights;
+        for (int i = 0; i < kernel_size; ++i) {
+            const uint8_t *level = rows[i] + x;
+            for (int j = 0; j < kernel_size; ++j, ++weight) {
+                const __m128 w = _mm_set1_ps(*weight);
+                for (int k = 0; k < 4; ++k)
+                    sums[k] = _mm_add_ps(sums[k], _mm_mul_ps(w, load_pixel_sse2(level + j + k * 4)));
+            }
+        }
+        _mm_storeu_si128((__m128i *) (out_levels + x), pack_pixels_sse2(round_clamped_sse2(sums[0]),
+                round_clamped_sse2(sums[1]), round_clamped_sse2(sums[2]), round_clamped_sse2(sums[3])));
+    }
+    for (; x + 4 <= width; x += 4)
+        convolve_gray_levels_sse2<K>(rows, kernel_size, weights, out_levels, x);
+    for (; x < width; ++x)
+        convolve_gray_pixel<K>(rows, kernel_size, weights, out_levels, x);
+}
+
+AIP_TARGET_SSE2 static void convolve_gray_row_sse2(const uint8_t *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_levels, int width) {
+    AIP_CONVOLVE_SIZED(convolve_gray_row_sse2_sized, kernel_size,
+            rows, kernel_size, weights, out_levels, width);
+}
+
+AIP_TARGET_SSE2 static void convolve_horizontal_sse2(const uint8_t *values, int step, int kernel_size, const float *weights,
+        float *out_sums, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128 sums[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+        for (int j = 0; j < kernel_size; ++j) {
+            const __m128i v = _mm_loadu_si128((const __m128i *) (values + i + j * step));
+            const __m128i low = _mm_unpacklo_epi8(v, zero);
+            const __m128i high = _mm_unpackhi_epi8(v, zero);
+            const __m128i channels[4] = {
+                _mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero),
+                _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero)
+            };
+            const __m128 w = _mm_set1_ps(weights[j]);
+            for (int k = 0; k < 4; ++k)
+                sums[k] = _mm_add_ps(sums[k], _mm_mul_ps(w, _mm_cvtepi32_ps(channels[k])));
+        }
+        for (int k = 0; k < 4; ++k)
+            _mm_storeu_ps(out_sums + i + k * 4, sums[k]);
+    }
+    convolve_horizontal_generic(values + i, step, kernel_size, weights, out_sums + i, count - i);
+}
+
+AIP_TARGET_SSE2 static void convolve_vertical_sse2(const float *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_values, int count) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128 sums[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+        for (int j = 0; j < kernel_size; ++j) {
+            const __m128 w = _mm_set1_ps(weights[j]);
+            for (int k = 0; k < 4; ++k)
+                sums[k] = _mm_add_ps(sums[k], _mm_mul_ps(w, _mm_loadu_ps(rows[j] + i + k * 4)));
+        }
+        _mm_storeu_si128((__m128i *) (out_values + i), pack_pixels_sse2(round_clamped_sse2(sums[0]),
+                round_clamped_sse2(sums[1]), round_clamped_sse2(sums[2]), round_clamped_sse2(sums[3])));
+    }
+    convolve_vertical_generic_tail(rows, kernel_size, weights, out_values, i, count);
+}
+
+/* AVX2, 8 floats: two RGBA pixels or 8 gray levels */
+
+AIP_TARGET_AVX2 static inline __m256i round_clamped_avx2(__m256 x) {
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-1.f)), _mm256_set1_ps(256.f));
+    const __m256i truncated = _mm256_cvttps_epi32(x);
+    const __m256 fraction = _mm256_sub_ps(x, _mm256_cvtepi32_ps(truncated));
+    const __m256i up = _mm256_castps_si256(_mm256_cmp_ps(fraction, _mm256_set1_ps(.5f), _CMP_GE_OQ));
+    const __m256i down = _mm256_castps_si256(_mm256_cmp_ps(fraction, _mm256_set1_ps(-.5f), _CMP_LE_OQ));
+    return _mm256_add_epi32(_mm256_sub_epi32(truncated, up), down);
+}
+
+// 16 channels (4 pixels) of two vectors of 32-bit channels to bytes, saturated to [0, 255]
+AIP_TARGET_AVX2 static inline __m128i pack_pixels_avx2(__m256i p0, __m256i p1) {
+    const __m128i low = _mm_packs_epi32(_mm256_castsi256_si128(p0), _mm256_extracti128_si256(p0, 1));
+    const __m128i high = _mm_packs_epi32(_mm256_castsi256_si128(p1), _mm256_extracti128_si256(p1, 1));
+    return _mm_packus_epi16(low, high);
+}
+
+AIP_TARGET_AVX2 static inline __m256 load_pixels_avx2(const uint8_t *pixels) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) pixels)));
+}
+
+// the 4 channels of a pixel at once, widened by SSE4.1
+AIP_TARGET_AVX2 static inline __m128 load_pixel_avx2(const uint8_t *pixel) {
+    int32_t bytes;
+    std::memcpy(&bytes, pixel, sizeof(bytes));
+    return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes)));
+}
+
+// the pixels after the last whole block, also for AVX-512
+template <int K>
+AIP_TARGET_AVX2 static void convolve_pixel_avx2(const uint8_t *const *rows, int kernel_size, const float *weights,
+        const uint8_t *alpha_pixels, uint8_t *out_pixels, int x) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    __m128 sum = _mm_setzero_ps();
+    const float *weight = weights;
+    for (int i = 0; i < kernel_size; ++i) {
+        const uint8_t *pixel = rows[i] + x * 4;
+        for (int j = 0; j < kernel_size; ++j, ++weight, pixel += 4)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(*weight), load_pixel_avx2(pixel)));
+    }
+    store_pixel_sse2(round_clamped_sse2(sum), alpha_pixels + x * 4, out_pixels + x * 4);
+}
+
+template <int K>
+AIP_TARGET_AVX2 static void convolve_gray_levels_avx2(const uint8_t *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_levels, int x) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    __m128 sum = _mm_setzero_ps();
+    const float *weight = weights;
+    for (int i = 0; i < kernel_size; ++i) {
+        const uint8_t *level = rows[i] + x;
+        for (int j = 0; j < kernel_size; ++j, ++weight)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(*weight), load_pixel_avx2(level + j)));
+    }
+    store_levels_sse2(round_clamped_sse2(sum), out_levels + x);
+}
+
+AIP_TARGET_AVX2 static void gray_row_avx2(const uint8_t *pixels, uint8_t *out_levels, int width) {
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i magic = _mm256_set1_epi32(0xAAAB);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i levels[2];
+        for (int k = 0; k < 2; ++k) {
+            const __m256i p = _mm256_loadu_si256((const __m256i *) (pixels + (x + k * 8) * 4));
+            __m256i sum = _mm256_add_epi32(_mm256_and_si256(p, byte_mask),
+                    _mm256_and_si256(_mm256_srli_epi32(p, 8), byte_mask));
+            sum = _mm256_add_epi32(sum, _mm256_and_si256(_mm256_srli_epi32(p, 16), byte_mask));
+            levels[k] = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_add_epi32(sum, one), magic), 17);
+        }
+        _mm_storeu_si128((__m128i *) (out_levels + x), pack_pixels_avx2(levels[0], levels[1]));
+    }
+    gray_row_generic(pixels + x * 4, out_levels + x, width - x);
+}
+
+AIP_TARGET_AVX2 static void add_noise_row_avx2(const uint8_t *pixels, uint8_t *out_pixels, int width, const float *noise) {
+    // noise of pixel x + k / 4 for channel k
+    const __m256i noise_index = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i p = _mm_loadu_si128((const __m128i *) (pixels + x * 4));
+        __m256i results[2];
+        for (int k = 0; k < 2; ++k) {
+            const __m256 n = _mm256_permutevar8x32_ps(
+                    _mm256_castps128_ps256(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *) (noise + x + k * 2)))),
+                    noise_index);
+            const __m256 value = _mm256_add_ps(load_pixels_avx2(pixels + (x + k * 2) * 4),
+                    _mm256_mul_ps(_mm256_set1_ps(255.f), n));
+            results[k] = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()),
+                    _mm256_set1_ps(255.f)));
+        }
+        _mm_storeu_si128((__m128i *) (out_pixels + x * 4), merge_alpha_sse2(pack_pixels_avx2(results[0], results[1]), p));
+    }
+    add_noise_row_generic(pixels + x * 4, out_pixels + x * 4, width - x, noise + x);
+}
+
+template <int K>
+AIP_TARGET_AVX2 static void convolve_row_avx2_sized(const uint8_t *const *rows, int kernel_size, const float *weights,
+        const uint8_t *alpha_pixels, uint8_t *out_pixels, int width) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256 sums[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        const float *weight = weights;
+        for (int i = 0; i < kernel_size; ++i) {
+            const uint8_t *pixel = rows[i] + x * 4;
+            for (int j = 0; j < kernel_size; ++j, ++weight, pixel += 4) {
+                const __m256 w = _mm256_set1_ps(*weight);
+                for (int k = 0; k < 4; ++k)
+                    sums[k] = _mm256_add_ps(sums[k], _mm256_mul_ps(w, load_pixels_avx2(pixel + k * 8)));
+            }
+        }
+
+        for (int k = 0; k < 2; ++k) {
+            const __m128i out = pack_pixels_avx2(round_clamped_avx2(sums[k * 2]), round_clamped_avx2(sums[k * 2 + 1]));
+            const __m128i alpha = _mm_loadu_si128((const __m128i *) (alpha_pixels + (x + k * 4) * 4));
+            _mm_storeu_si128((__m128i *) (out_pixels + (x + k * 4) * 4), merge_alpha_sse2(out, alpha));
+        }
+    }
+    for (; x < width; ++x)
+        convolve_pixel_avx2<K>(rows, kernel_size, weights, alpha_pixels, out_pixels, x);
+}
+
+AIP_TARGET_AVX2 static void convolve_row_avx2(const uint8_t *const *rows, int kernel_size, const float *weights,
+        const uint8_t *alpha_pixels, uint8_t *out_pixels, int width) {
+    AIP_CONVOLVE_SIZED(convolve_row_avx2_sized, kernel_size,
+            rows, kernel_size, weights, alpha_pixels, out_pixels, width);
+}
+
+template <int K>
+AIP_TARGET_AVX2 static void convolve_gray_row_avx2_sized(const uint8_t *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_levels, int width) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256 sums[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        const float *weight = weights;
+        for (int i = 0; i < kernel_size; ++i) {
+            const uint8_t *level = rows[i] + x;
+            for (int j = 0; j < kernel_size; ++j, ++weight) {
+                const __m256 w = _mm256_set1_ps(*weight);
+                for (int k = 0; k < 4; ++k)
+                    sums[k] = _mm256_add_ps(sums[k], _mm256_mul_ps(w, load_pixels_avx2(level + j + k * 8)));
+            }
+        }
+        for (int k = 0; k < 2; ++k) {
+            _mm_storeu_si128((__m128i *) (out_levels + x + k * 16),
+                    pack_pixels_avx2(round_clamped_avx2(sums[k * 2]), round_clamped_avx2(sums[k * 2 + 1])));
+        }
+    }
+    for (; x + 4 <= width; x += 4)
+        convolve_gray_levels_avx2<K>(rows, kernel_size, weights, out_levels, x);
+    for (; x < width; ++x)
+        convolve_gray_pixel<K>(rows, kernel_size, weights, out_levels, x);
+}
+
+AIP_TARGET_AVX2 static void convolve_gray_row_avx2(const uint8_t *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_levels, int width) {
+    AIP_CONVOLVE_SIZED(convolve_gray_row_avx2_sized, kernel_size,
+            rows, kernel_size, weights, out_levels, width);
+}
+
+AIP_TARGET_AVX2 static void convolve_horizontal_avx2(const uint8_t *values, int step, int kernel_size, const float *weights,
+        float *out_sums, int count) {
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256 sums[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        for (int j = 0; j < kernel_size; ++j) {
+            const __m256 w = _mm256_set1_ps(weights[j]);
+            for (int k = 0; k < 4; ++k)
+                sums[k] = _mm256_add_ps(sums[k], _mm256_mul_ps(w, load_pixels_avx2(values + i + j * step + k * 8)));
+        }
+        for (int k = 0; k < 4; ++k)
+            _mm256_storeu_ps(out_sums + i + k * 8, sums[k]);
+    }
+    convolve_horizontal_generic(values + i, step, kernel_size, weights, out_sums + i, count - i);
+}
+
+AIP_TARGET_AVX2 static void convolve_vertical_avx2(const float *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_values, int count) {
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256 sums[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        for (int j = 0; j < kernel_size; ++j) {
+            const __m256 w = _mm256_set1_ps(weights[j]);
+            for (int k = 0; k < 4; ++k)
+                sums[k] = _mm256_add_ps(sums[k], _mm256_mul_ps(w, _mm256_loadu_ps(rows[j] + i + k * 8)));
+        }
+        for (int k = 0; k < 2; ++k) {
+            _mm_storeu_si128((__m128i *) (out_values + i + k * 16),
+                    pack_pixels_avx2(round_clamped_avx2(sums[k * 2]), round_clamped_avx2(sums[k * 2 + 1])));
+        }
+    }
+    convolve_vertical_generic_tail(rows, kernel_size, weights, out_values, i, count);
+}
+
+/* AVX-512, 16 floats: four RGBA pixels or 16 gray levels */
+
+AIP_TARGET_AVX512 static inline __m128i round_clamped_avx512(__m512 x) {
+    x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-1.f)), _mm512_set1_ps(256.f));
+    const __m512i truncated = _mm512_cvttps_epi32(x);
+    const __m512 fraction = _mm512_sub_ps(x, _mm512_cvtepi32_ps(truncated));
+    const __mmask16 up = _mm512_cmp_ps_mask(fraction, _mm512_set1_ps(.5f), _CMP_GE_OQ);
+    const __mmask16 down = _mm512_cmp_ps_mask(fraction, _mm512_set1_ps(-.5f), _CMP_LE_OQ);
+    __m512i rounded = _mm512_mask_add_epi32(truncated, up, truncated, _mm512_set1_epi32(1));
+    rounded = _mm512_mask_sub_epi32(rounded, down, rounded, _mm512_set1_epi32(1));
+    rounded = _mm512_min_epi32(_mm512_max_epi32(rounded, _mm512_setzero_si512()), _mm512_set1_epi32(255));
+    return _mm512_cvtepi32_epi8(rounded);
+}
+
+AIP_TARGET_AVX512 static inline __m512 load_pixels_avx512(const uint8_t *pixels) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) pixels)));
+}
+
+AIP_TARGET_AVX512 static void gray_row_avx512(const uint8_t *pixels, uint8_t *out_levels, int width) {
+    const __m512i byte_mask = _mm512_set1_epi32(0xFF);
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i magic = _mm512_set1_epi32(0xAAAB);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m512i p = _mm512_loadu_si512(pixels + x * 4);
+        __m512i sum = _mm512_add_epi32(_mm512_and_si512(p, byte_mask),
+                _mm512_and_si512(_mm512_srli_epi32(p, 8), byte_mask));
+        sum = _mm512_add_epi32(sum, _mm512_and_si512(_mm512_srli_epi32(p, 16), byte_mask));
+        const __m512i levels = _mm512_srli_epi32(_mm512_mullo_epi32(_mm512_add_epi32(sum, one), magic), 17);
+        _mm_storeu_si128((__m128i *) (out_levels + x), _mm512_cvtepi32_epi8(levels));
+    }
+    gray_row_generic(pixels + x * 4, out_levels + x, width - x);
+}
+
+AIP_TARGET_AVX512 static void add_noise_row_avx512(const uint8_t *pixels, uint8_t *out_pixels, int width,
+        const float *noise) {
+    const __m512i noise_index = _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i p = _mm_loadu_si128((const __m128i *) (pixels + x * 4));
+        const __m512 n = _mm512_permutexvar_ps(noise_index, _mm512_castps128_ps512(_mm_loadu_ps(noise + x)));
+        const __m512 value = _mm512_add_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(p)),
+                _mm512_mul_ps(_mm512_set1_ps(255.f), n));
+        const __m512i result = _mm512_cvttps_epi32(_mm512_min_ps(_mm512_max_ps(value, _mm512_setzero_ps()),
+                _mm512_set1_ps(255.f)));
+        _mm_storeu_si128((__m128i *) (out_pixels + x * 4), merge_alpha_sse2(_mm512_cvtepi32_epi8(result), p));
+    }
+    add_noise_row_generic(pixels + x * 4, out_pixels + x * 4, width - x, noise + x);
+}
+
+template <int K>
+AIP_TARGET_AVX512 static void convolve_row_avx512_sized(const uint8_t *const *rows, int kernel_size, const float *weights,
+        const uint8_t *alpha_pixels, uint8_t *out_pixels, int width) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m512 sums[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+        const float *weight = weights;
+        for (int i = 0; i < kernel_size; ++i) {
+            const uint8_t *pixel = rows[i] + x * 4;
+            for (int j = 0; j < kernel_size; ++j, ++weight, pixel += 4) {
+                const __m512 w = _mm512_set1_ps(*weight);
+                for (int k = 0; k < 4; ++k)
+                    sums[k] = _mm512_add_ps(sums[k], _mm512_mul_ps(w, load_pixels_avx512(pixel + k * 16)));
+            }
+        }
+
+        for (int k = 0; k < 4; ++k) {
+            const __m128i alpha = _mm_loadu_si128((const __m128i *) (alpha_pixels + (x + k * 4) * 4));
+            _mm_storeu_si128((__m128i *) (out_pixels + (x + k * 4) * 4),
+                    merge_alpha_sse2(round_clamped_avx512(sums[k]), alpha));
+        }
+    }
+    for (; x < width; ++x)
+        convolve_pixel_avx2<K>(rows, kernel_size, weights, alpha_pixels, out_pixels, x);
+}
+
+AIP_TARGET_AVX512 static void convolve_row_avx512(const uint8_t *const *rows, int kernel_size, const float *weights,
+        const uint8_t *alpha_pixels, uint8_t *out_pixels, int width) {
+    AIP_CONVOLVE_SIZED(convolve_row_avx512_sized, kernel_size,
+            rows, kernel_size, weights, alpha_pixels, out_pixels, width);
+}
+
+template <int K>
+AIP_TARGET_AVX512 static void convolve_gray_row_avx512_sized(const uint8_t *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_levels, int width) {
+    if constexpr (K > 0)
+        kernel_size = K;
+    int x = 0;
+    for (; x + 64 <= width; x += 64) {
+        __m512 sums[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+        const float *weight = weights;
+        for (int i = 0; i < kernel_size; ++i) {
+            const uint8_t *level = rows[i] + x;
+            for (int j = 0; j < kernel_size; ++j, ++weight) {
+                const __m512 w = _mm512_set1_ps(*weight);
+                for (int k = 0; k < 4; ++k)
+                    sums[k] = _mm512_add_ps(sums[k], _mm512_mul_ps(w, load_pixels_avx512(level + j + k * 16)));
+            }
+        }
+        for (int k = 0; k < 4; ++k)
+            _mm_storeu_si128((__m128i *) (out_levels + x + k * 16), round_clamped_avx512(sums[k]));
+    }
+    for (; x + 4 <= width; x += 4)
+        convolve_gray_levels_avx2<K>(rows, kernel_size, weights, out_levels, x);
+    for (; x < width; ++x)
+        convolve_gray_pixel<K>(rows, kernel_size, weights, out_levels, x);
+}
+
+AIP_TARGET_AVX512 static void convolve_gray_row_avx512(const uint8_t *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_levels, int width) {
+    AIP_CONVOLVE_SIZED(convolve_gray_row_avx512_sized, kernel_size,
+            rows, kernel_size, weights, out_levels, width);
+}
+
+AIP_TARGET_AVX512 static void convolve_horizontal_avx512(const uint8_t *values, int step, int kernel_size,
+        const float *weights, float *out_sums, int count) {
+    int i = 0;
+    for (; i + 64 <= count; i += 64) {
+        __m512 sums[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+        for (int j = 0; j < kernel_size; ++j) {
+            const __m512 w = _mm512_set1_ps(weights[j]);
+            for (int k = 0; k < 4; ++k)
+                sums[k] = _mm512_add_ps(sums[k], _mm512_mul_ps(w, load_pixels_avx512(values + i + j * step + k * 16)));
+        }
+        for (int k = 0; k < 4; ++k)
+            _mm512_storeu_ps(out_sums + i + k * 16, sums[k]);
+    }
+    convolve_horizontal_generic(values + i, step, kernel_size, weights, out_sums + i, count - i);
+}
+
+AIP_TARGET_AVX512 static void convolve_vertical_avx512(const float *const *rows, int kernel_size, const float *weights,
+        uint8_t *out_values, int count) {
+    int i = 0;
+    for (; i + 64 <= count; i += 64) {
+        __m512 sums[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+        for (int j = 0; j < kernel_size; ++j) {
+            const __m512 w = _mm512_set1_ps(weights[j]);
+            for (int k = 0; k < 4; ++k)
+                sums[k] = _mm512_add_ps(sums[k], _mm512_mul_ps(w, _mm512_loadu_ps(rows[j] + i + k * 16)));
+        }
+        for (int k = 0; k < 4; ++k)
+            _mm_storeu_si128((__m128i *) (out_values + i + k * 16), round_clamped_avx512(sums[k]));
+    }
+    convolve_vertical_generic_tail(rows, kernel_size, weights, out_values, i, count);
+}
+
+#endif // AIP_X86_KERNELS
+
+static const PixelKernels generic_kernels = {
+    CpuLevel::GENERIC,
+    gray_row_generic,
+    count_levels_generic,
+    lookup_table_row_generic,
+    add_noise_row_generic,
+    convolve_row_generic,
+    convolve_gray_row_generic,
+    convolve_horizontal_generic,
+    convolve_vertical_generic,
+    resize_generic,
+    resize_float_generic
+};
+
+#ifdef AIP_X86_KERNELS
+
+static const PixelKernels sse2_kernels = {
+    CpuLevel::SSE2,
+    gray_row_sse2,
+    count_levels_generic,
+    lookup_table_row_generic,
+    add_noise_row_sse2,
+    convolve_row_sse2,
+    convolve_gray_row_sse2,
+    convolve_horizontal_sse2,
+    convolve_vertical_sse2,
+    resize_sse2,
+    resize_float_sse2
+};
+
+static const PixelKernels avx2_kernels = {
+    CpuLevel::AVX2,
+    gray_row_avx2,
+    count_levels_generic,
+    lookup_table_row_generic,
+    add_noise_row_avx2,
+    convolve_row_avx2,
+    convolve_gray_row_avx2,
+    convolve_horizontal_avx2,
+    convolve_vertical_avx2,
+    resize_avx2,
+    resize_float_avx2
+};
+
+static const PixelKernels avx512_kernels = {
+    CpuLevel::AVX512,
+    gray_row_avx512,
+    count_levels_generic,
+    lookup_table_row_generic,
+    add_noise_row_avx512,
+    convolve_row_avx512,
+    convolve_gray_row_avx512,
+    convolve_horizontal_avx512,
+    convolve_vertical_avx512,
+    resize_avx512,
+    resize_float_avx512
+};
+
+#endif // AIP_X86_KERNELS
+
+// here rather than with the convolution, as fast math would compute the row factors with approximate reciprocals
+bool factor_separable_kernel(int kernel_size, const float *kernel, float *out_column, float *out_row) {
+    // the factors go through the largest weight: its column, and its row divided by it
+    const int count = kernel_size * kernel_size;
+    const int pivot = (int) (std::max_element(kernel, kernel + count,
+            [](float a, float b) { return std::abs(a) < std::abs(b); }) - kernel);
+    const int pivot_i = pivot / kernel_size;
+    const int pivot_j = pivot % kernel_size;
+    if (kernel[pivot] == 0.f)
+        return false;
+
+    for (int i = 0; i < kernel_size; ++i) {
+        out_column[i] = kernel[i * kernel_size + pivot_j];
+        out_row[i] = (double) kernel[pivot_i * kernel_size + i] / kernel[pivot];
+    }
+
+    // the factored kernel may change a sum of levels by at most a thousandth of a level,
+    // so the rounded results stay the same but for sums within that distance of a rounding boundary
+    constexpr double max_level_error = 1e-3;
+    double error = 0.;
+    for (int i = 0; i < kernel_size; ++i) {
+        for (int j = 0; j < kernel_size; ++j)
+            error += std::abs((double) kernel[i * kernel_size + j] - (double) out_column[i] * out_row[j]);
+    }
+    return 255. * error <= max_level_error;
+}
+
+const PixelKernels &get_pixel_kernels() {
+    static const PixelKernels &kernels = get_pixel_kernels(get_cpu_level());
+    return kernels;
+}
+
+const PixelKernels &get_pixel_kernels(CpuLevel level) {
+    // never above what the CPU supports
+    if (level > detect_cpu_level())
+        level = detect_cpu_level();
+
+#ifdef AIP_X86_KERNELS
+    switch (level) {
+    case CpuLevel::SSE2:
+        return sse2_kernels;
+    case CpuLevel::AVX2:
+        return avx2_kernels;
+    case CpuLevel::AVX512:
+        return avx512_kernels;
+    default:
+        break;
+    }
+#endif // AIP_X86_KERNELS
+    return generic_kernels;
+}
@@ -0,0 +1,58 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_PIXEL_KERNELS_H__
+#define ADVANCED_IMAGE_PROCESSOR_PIXEL_KERNELS_H__
+
+#include <cstdint>
+
+#include "cpu_features.h"
+
+/*
+ * Inner loops of the hot operations, one implementation per instruction set
+ * level, chosen once from the CPU the program runs on. All levels give
+ * bit-identical results.
+ *
+ * Row kernels work on RGBA pixels (4 bytes) or gray levels (1 byte) and
+ * may write over their input (out_pixels == pixels). Convolution kernels
+ * read the taps of output pixel x at rows[i] + (x + j) * 4 (x + j for
+ * gray), with the weights in the same order as the taps, that is the
+ * kernel flipped. The two passes of a separable convolution work on flat
+ * arrays of channels: the horizontal pass sums taps step channels apart
+ * into floats, the vertical pass sums the same channel of float rows.
+ */
+struct PixelKernels {
+    CpuLevel level;
+
+    // gray level of each pixel, round((R + G + B) / 3)
+    void (*gray_row)(const uint8_t *pixels, uint8_t *out_levels, int width);
+    // count of each gray level added to level_count
+    void (*count_levels)(const uint8_t *levels, int count, int *level_count);
+    // color channels through the lookup table, alpha kept
+    void (*lookup_table_row)(const uint8_t *pixels, uint8_t *out_pixels, int width, const uint8_t *lut);
+    // color channels plus 255 times the noise of the pixel, clamped; alpha kept
+    void (*add_noise_row)(const uint8_t *pixels, uint8_t *out_pixels, int width, const float *noise);
+    // color channels convolved, rounded and clamped; alpha copied from alpha_pixels
+    void (*convolve_row)(const uint8_t *const *rows, int kernel_size, const float *weights,
+            const uint8_t *alpha_pixels, uint8_t *out_pixels, int width);
+    void (*convolve_gray_row)(const uint8_t *const *rows, int kernel_size, const float *weights,
+            uint8_t *out_levels, int width);
+    // out_sums[i] = sum of weights[j] * values[i + j * step], for i < count
+    void (*convolve_horizontal)(const uint8_t *values, int step, int kernel_size, const float *weights,
+            float *out_sums, int count);
+    // out_values[i] = sum of weights[j] * rows[j][i], rounded and clamped, for i < count
+    void (*convolve_vertical)(const float *const *rows, int kernel_size, const float *weights,
+            uint8_t *out_values, int count);
+    // stb_image_resize of images of 1 to 4 channels, a stride of 0 for packed rows
+    bool (*resize)(const uint8_t *pixels, int width, int height, int stride,
+            uint8_t *out_pixels, int out_width, int out_height, int out_stride, int channels);
+    bool (*resize_float)(const float *pixels, int width, int height, int stride,
+            float *out_pixels, int out_width, int out_height, int out_stride, int channels);
+};
+
+const PixelKernels &get_pixel_kernels();
+const PixelKernels &get_pixel_kernels(CpuLevel level);
+
+// smallest kernel run as two passes when separable, smaller ones are faster as one
+constexpr int min_separable_kernel_size = 5;
+// rank-1 factors of a convolution kernel, kernel[i * kernel_size + j] = column[i] * row[j]; false if it is not separable
+bool factor_separable_kernel(int kernel_size, const float *kernel, float *out_column, float *out_row);
+
+#endif // ADVANCED_IMAGE_PROCESSOR_PIXEL_KERNELS_H__
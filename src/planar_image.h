@@ -0,0 +1,110 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_PLANAR_IMAGE_H__
+#define ADVANCED_IMAGE_PROCESSOR_PLANAR_IMAGE_H__
+
+#include <cstdint>
+
+#include "image.h"
+#include "image_view.h"
+#include "thread_pool.h"
+#include "typed_image.h"
+
+/*
+ * Image stored as one plane per channel (structure of arrays).
+ *
+ * Each plane is a contiguous single channel image, so a kernel working on
+ * one channel reads only that channel's memory with unit stride.
+ */
+template <typename T, int C>
+class PlanarImage {
+public:
+
+    using value_type = T;
+    static constexpr int channels = C;
+    using PlaneView = BasicImageView<T, 1>;
+    using ConstPlaneView = BasicImageView<const T, 1>;
+
+    PlanarImage() = default;
+
+    PlanarImage(int width, int height, Image::InitMode init_mode=Image::INIT_WHITE) {
+        init(width, height, init_mode);
+    }
+
+    void init(int width, int height, Image::InitMode init_mode=Image::INIT_WHITE) {
+        for (int c = 0; c < C; ++c)
+            _planes[c].init(width, height, init_mode);
+    }
+
+    void close() {
+        for (int c = 0; c < C; ++c)
+            _planes[c].close();
+    }
+
+    bool good() const { return _planes[0].good(); }
+    int getImageWidth() const { return _planes[0].getImageWidth(); }
+    int getImageHeight() const { return _planes[0].getImageHeight(); }
+
+    PlaneView plane(int channel) { return _planes[channel].view(); }
+    ConstPlaneView plane(int channel) const { return _planes[channel].view(); }
+
+private:
+    TypedImage<T, 1> _planes[C];
+};
+
+using PlanarRGBA8Image = PlanarImage<uint8_t, 4>;
+using PlanarRGBA32FImage = PlanarImage<float, 4>;
+
+/*
+ * Conversions between interleaved pixels and planes of the same size, in
+ * one pass over the interleaved rows spread over the thread pool. The
+ * view forms convert the first count channels only, e.g. the color
+ * channels of RGBA pixels into three planes.
+ */
+template <typename T, int C>
+void deinterleave(const BasicImageView<const T, C> &src, const BasicImageView<T, 1> *planes, int count=C) {
+    parallel_for_rows(src.getImageWidth(), src.getImageHeight(), [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y) {
+            const T *src_row = src.row(y);
+            for (int c = 0; c < count; ++c) {
+                T *plane_row = planes[c].row(y);
+                for (int x = 0; x < src.getImageWidth(); ++x)
+                    plane_row[x] = src_row[x * C + c];
+            }
+        }
+    });
+}
+
+template <typename T, int C>
+void interleave(const BasicImageView<const T, 1> *planes, const BasicImageView<T, C> &dst, int count=C) {
+    parallel_for_rows(dst.getImageWidth(), dst.getImageHeight(), [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y) {
+            T *dst_row = dst.row(y);
+            for (int c = 0; c < count; ++c) {
+                const T *plane_row = planes[c].row(y);
+                for (int x = 0; x < dst.getImageWidth(); ++x)
+                    dst_row[x * C + c] = plane_row[x];
+            }
+        }
+    });
+}
+
+// dst is (re)initialized when its size differs
+template <typename T, int C>
+void deinterleave(const BasicImageView<const T, C> &src, PlanarImage<T, C> &dst) {
+    if (dst.getImageWidth() != src.getImageWidth() || dst.getImageHeight() != src.getImageHeight())
+        dst.init(src.getImageWidth(), src.getImageHeight(), Image::INIT_UNINITIALIZED);
+
+    BasicImageView<T, 1> planes[C];
+    for (int c = 0; c < C; ++c)
+        planes[c] = dst.plane(c);
+    deinterleave(src, planes);
+}
+
+template <typename T, int C>
+void interleave(const PlanarImage<T, C> &src, const BasicImageView<T, C> &dst) {
+    BasicImageView<const T, 1> planes[C];
+    for (int c = 0; c < C; ++c)
+        planes[c] = src.plane(c);
+    interleave(planes, dst);
+}
+
+#endif // ADVANCED_IMAGE_PROCESSOR_PLANAR_IMAGE_H__
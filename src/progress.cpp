@@ -0,0 +1,37 @@
+#include "progress.h"
+
+#include <algorithm>
+#include <cstdint>
+
+Progress::Progress() : _total(0), _done(0), _canceled(false), _finished(false) {}
+
+void Progress::addTotal(int64_t units) {
+    _total += units;
+}
+
+void Progress::advance(int64_t units) {
+    _done += units;
+}
+
+float Progress::getFraction() const {
+    if (_finished)
+        return 1.f;
+    const int64_t total = _total;
+    return total > 0 ? std::min(1.f, (float) ((double) _done / total)) : 0.f;
+}
+
+void Progress::cancel() {
+    _canceled = true;
+}
+
+bool Progress::isCanceled() const {
+    return _canceled;
+}
+
+void Progress::finish() {
+    _finished = true;
+}
+
+bool Progress::isFinished() const {
+    return _finished;
+}
@@ -0,0 +1,44 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_PROGRESS_H__
+#define ADVANCED_IMAGE_PROCESSOR_PROGRESS_H__
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Progress and cancellation of an operation, shared between the threads
+ * running it and the UI.
+ *
+ * Algorithms add the units of work (rows or tiles) they are going to do,
+ * report finished units and stop at the next row band or tile once the
+ * operation is canceled. The output of a canceled operation is incomplete.
+ */
+class Progress {
+public:
+
+    Progress();
+
+    void addTotal(int64_t units);
+    void advance(int64_t units);
+    // fraction of the work done so far, in [0, 1]
+    float getFraction() const;
+
+    void cancel();
+    bool isCanceled() const;
+
+    // set by whoever runs the operation once it returned
+    void finish();
+    bool isFinished() const;
+
+private:
+    std::atomic<int64_t> _total;
+    std::atomic<int64_t> _done;
+    std::atomic<bool> _canceled;
+    std::atomic<bool> _finished;
+};
+
+// polling helper for optional progress arguments
+inline bool is_canceled(const Progress *progress) {
+    return progress != nullptr && progress->isCanceled();
+}
+
+#endif // ADVANCED_IMAGE_PROCESSOR_PROGRESS_H__
@@ -0,0 +1,63 @@
+/*
+ * stb_image_resize built for one instruction set level, so the compiler
+ * vectorizes it for that level. This file is compiled once per level with
+ * AIP_RESIZE_LEVEL_SSE2, AIP_RESIZE_LEVEL_AVX2 or AIP_RESIZE_LEVEL_AVX512
+ * defined; pixel_kernels.cpp picks the one to call.
+ */
+
+// the standard headers stb_image_resize uses are built for the baseline, only its own functions for the level
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// pragmas take no macros, each level spells its target
+#ifndef __clang__
+    #pragma GCC push_options
+#endif
+
+#if defined(AIP_RESIZE_LEVEL_SSE2)
+    #define AIP_RESIZE_NAME(name) name##_sse2
+    #ifdef __clang__
+        #pragma clang attribute push(__attribute__((target("sse2"))), apply_to = function)
+    #else
+        #pragma GCC target("sse2")
+    #endif
+#elif defined(AIP_RESIZE_LEVEL_AVX2)
+    #define AIP_RESIZE_NAME(name) name##_avx2
+    #ifdef __clang__
+        #pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+    #else
+        #pragma GCC target("avx2")
+    #endif
+#elif defined(AIP_RESIZE_LEVEL_AVX512)
+    #define AIP_RESIZE_NAME(name) name##_avx512
+    #ifdef __clang__
+        #pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+    #else
+        #pragma GCC target("avx512f")
+    #endif
+#else
+    #error "define the instruction set level of the resize kernels"
+#endif
+
+#define STB_IMAGE_RESIZE_STATIC
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
+
+#ifdef __clang__
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+
+bool AIP_RESIZE_NAME(resize)(const uint8_t *pixels, int width, int height, int stride,
+        uint8_t *out_pixels, int out_width, int out_height, int out_stride, int channels) {
+    return stbir_resize_uint8(pixels, width, height, stride, out_pixels, out_width, out_height, out_stride, channels);
+}
+
+bool AIP_RESIZE_NAME(resize_float)(const float *pixels, int width, int height, int stride,
+        float *out_pixels, int out_width, int out_height, int out_stride, int channels) {
+    return stbir_resize_float(pixels, width, height, stride, out_pixels, out_width, out_height, out_stride, channels);
+}
@@ -0,0 +1,163 @@
+#include "result_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "image.h"
+#include "image_view.h"
+#include "thread_pool.h"
+
+static constexpr uint64_t hash_prime_1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t hash_prime_2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t hash_prime_3 = 0x165667B19E3779F9ull;
+
+static uint64_t rotate_left(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static uint64_t read_word(const uint8_t *p) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static uint64_t hash_round(uint64_t accumulator, uint64_t word) {
+    return rotate_left(accumulator + word * hash_prime_2, 31) * hash_prime_1;
+}
+
+static uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= hash_prime_2;
+    h ^= h >> 29;
+    h *= hash_prime_3;
+    h ^= h >> 32;
+    return h;
+}
+
+// hash of a run of bytes in the manner of xxHash64, four independent lanes over 32 byte stripes
+static uint64_t hash_bytes(const uint8_t *data, std::size_t size, uint64_t seed) {
+    uint64_t lanes[4] = {seed + hash_prime_1, seed + hash_prime_2, seed, seed - hash_prime_1};
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; ++lane)
+            lanes[lane] = hash_round(lanes[lane], read_word(data + i + lane * 8));
+    }
+
+    uint64_t h = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) +
+            rotate_left(lanes[3], 18) + size;
+    for (; i + 8 <= size; i += 8)
+        h = hash_round(h, read_word(data + i));
+    for (; i < size; ++i)
+        h = rotate_left(h ^ (data[i] * hash_prime_3), 11) * hash_prime_1;
+    return hash_mix(h);
+}
+
+uint64_t hash_pixels(ConstImageView image) {
+    // rows are hashed independently, then the row hashes in order
+    std::vector<uint64_t> row_hashes(image.getImageHeight());
+    const std::size_t row_size = (std::size_t) image.getImageWidth() * 4;
+    parallel_for_rows(image.getImageWidth(), image.getImageHeight(), [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y)
+            row_hashes[y] = hash_bytes(image.row(y), row_size, y);
+    });
+    return hash_bytes((const uint8_t *) row_hashes.data(), row_hashes.size() * sizeof(uint64_t), row_size);
+}
+
+ResultKey::ResultKey(const std::string &operation, ConstImageView image) : _bytes(operation) {
+    _bytes.push_back('\0');
+    add(image.getImageWidth());
+    add(image.getImageHeight());
+    add(hash_pixels(image));
+}
+
+void ResultKey::add(const void *data, std::size_t size) {
+    _bytes.append((const char *) data, size);
+}
+
+const std::string &ResultKey::getBytes() const {
+    return _bytes;
+}
+
+ResultCache &ResultCache::instance() {
+    static ResultCache cache((std::size_t) 512 << 20);
+    return cache;
+}
+
+ResultCache::ResultCache(std::size_t budget_bytes) : _budget(budget_bytes), _size(0) {}
+
+std::shared_ptr<Image> ResultCache::find(const ResultKey &key) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto it = _index.find(key.getBytes());
+    if (it == _index.end())
+        return nullptr;
+
+    // move to the front as the most recently used
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return std::make_shared<Image>(*it->second->image);
+}
+
+void ResultCache::insert(const ResultKey &key, const std::shared_ptr<Image> &image) {
+    if (image == nullptr)
+        return;
+
+    const std::size_t size = (std::size_t) image->getImageWidth() * image->getImageHeight() * 4;
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (size > _budget)
+        return;
+
+    const auto it = _index.find(key.getBytes());
+    if (it != _index.end()) {
+        _size -= it->second->size;
+        _entries.erase(it->second);
+        _index.erase(it);
+    }
+
+    _entries.push_front({key.getBytes(), std::make_shared<Image>(*image), size});
+    _index[key.getBytes()] = _entries.begin();
+    _size += size;
+    evict();
+}
+
+void ResultCache::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+    _index.clear();
+    _size = 0;
+}
+
+void ResultCache::setBudget(std::size_t budget_bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _budget = budget_bytes;
+    evict();
+}
+
+std::size_t ResultCache::getBudget() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _budget;
+}
+
+std::size_t ResultCache::getSize() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _size;
+}
+
+int ResultCache::getCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return (int) _entries.size();
+}
+
+void ResultCache::evict() {
+    // called with the mutex locked
+    while (_size > _budget && !_entries.empty()) {
+        const Entry &entry = _entries.back();
+        _size -= entry.size;
+        _index.erase(entry.key);
+        _entries.pop_back();
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_RESULT_CACHE_H__
+#define ADVANCED_IMAGE_PROCESSOR_RESULT_CACHE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+#include "image.h"
+#include "image_view.h"
+
+// fast 64-bit hash of the pixels of the image, the same whatever the number of threads
+uint64_t hash_pixels(ConstImageView image);
+
+/*
+ * Key of an operation result: the operation name, the size and content hash
+ * of its input and the bytes of every parameter added.
+ */
+class ResultKey {
+public:
+
+    ResultKey(const std::string &operation, ConstImageView image);
+
+    void add(const void *data, std::size_t size);
+    template <typename T>
+    void add(const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        add(&value, sizeof(value));
+    }
+
+    const std::string &getBytes() const;
+
+private:
+    std::string _bytes;
+};
+
+/*
+ * Results of operations for their key, so operations repeated with the same
+ * parameters on the same pixels come back without being computed again.
+ *
+ * The pixels of the cached images are counted against a memory budget, the
+ * least recently used results are dropped when it is exceeded. Cached
+ * images share their pixels with the images given and returned, which are
+ * copied on write. Safe to use from several threads.
+ */
+class ResultCache {
+public:
+
+    static ResultCache &instance();
+
+    explicit ResultCache(std::size_t budget_bytes);
+    ResultCache(const ResultCache &other) = delete;
+
+    ResultCache &operator=(const ResultCache &other) = delete;
+
+    // a copy of the cached result, nullptr when there is none
+    std::shared_ptr<Image> find(const ResultKey &key);
+    void insert(const ResultKey &key, const std::shared_ptr<Image> &image);
+    void clear();
+
+    void setBudget(std::size_t budget_bytes);
+    std::size_t getBudget() const;
+    std::size_t getSize() const;
+    int getCount() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<Image> image;
+        std::size_t size;
+    };
+
+    void evict();
+
+    // most recently used first
+    std::list<Entry> _entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+    std::size_t _budget;
+    std::size_t _size;
+    mutable std::mutex _mutex;
+};
+
+#endif // ADVANCED_IMAGE_PROCESSOR_RESULT_CACHE_H__
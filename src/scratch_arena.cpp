@@ -0,0 +1,124 @@
+#include "scratch_arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+static constexpr std::size_t default_retained_size = 256 * 1024 * 1024;
+static constexpr std::size_t min_block_size = 1024 * 1024;
+
+std::atomic<std::size_t> ScratchArena::_retained_size(default_retained_size);
+std::atomic<std::size_t> ScratchArena::_retained_total(0);
+
+ScratchArena &ScratchArena::local() {
+    static thread_local ScratchArena arena;
+    return arena;
+}
+
+ScratchArena::ScratchArena() : _current_block(0), _offset(0), _depth(0), _retained(0) {}
+
+ScratchArena::~ScratchArena() {
+    freeBlocks(0);
+    _retained_total -= _retained;
+}
+
+uint8_t *ScratchArena::allocate(std::size_t size_in_bytes) {
+    // whole multiples of the alignment keep the next allocation aligned
+    const std::size_t size = (std::max<std::size_t>(size_in_bytes, 1) + alignment - 1) / alignment * alignment;
+
+    if (_current_block < _blocks.size() && _offset + size <= _blocks[_current_block].size) {
+        uint8_t *data = _blocks[_current_block].data + _offset;
+        _offset += size;
+        return data;
+    }
+
+    // the next block, which is free, or a new one replacing it and the blocks after it when it is too small
+    const std::size_t next_block = (_offset == 0) ? _current_block : _current_block + 1;
+    if (next_block >= _blocks.size() || _blocks[next_block].size < size) {
+        freeBlocks(next_block);
+        const std::size_t block_size = std::max({size, getReserved(), min_block_size});
+        _blocks.push_back({static_cast<uint8_t *>(::operator new(block_size, std::align_val_t(alignment))), block_size});
+    }
+
+    _current_block = next_block;
+    _offset = size;
+    return _blocks[next_block].data;
+}
+
+std::size_t ScratchArena::getUsed() const {
+    std::size_t used = _offset;
+    for (std::size_t i = 0; i < _current_block && i < _blocks.size(); ++i)
+        used += _blocks[i].size;
+    return used;
+}
+
+std::size_t ScratchArena::getReserved() const {
+    std::size_t reserved = 0;
+    for (const Block &block : _blocks)
+        reserved += block.size;
+    return reserved;
+}
+
+void ScratchArena::setRetainedSize(std::size_t size_in_bytes) {
+    _retained_size = size_in_bytes;
+}
+
+std::size_t ScratchArena::getRetainedSize() {
+    return _retained_size;
+}
+
+ScratchArena::Marker ScratchArena::mark() const {
+    return {_current_block, _offset};
+}
+
+void ScratchArena::release(const Marker &marker) {
+    _current_block = marker.block;
+    _offset = marker.offset;
+}
+
+void ScratchArena::reset() {
+    _current_block = 0;
+    _offset = 0;
+
+    // the share of the budget held since the last reset is taken again for the new peak
+    const std::size_t reserved = getReserved();
+    _retained_total -= _retained;
+    _retained = 0;
+    const bool is_retained = retain(reserved);
+    if (is_retained)
+        _retained = reserved;
+    if (_blocks.size() <= 1 && is_retained)
+        return;
+
+    // one block for the peak of the next operation, if it may be kept
+    freeBlocks(0);
+    if (is_retained)
+        _blocks.push_back({static_cast<uint8_t *>(::operator new(reserved, std::align_val_t(alignment))), reserved});
+}
+
+bool ScratchArena::retain(std::size_t size_in_bytes) {
+    std::size_t total = _retained_total;
+    do {
+        if (total + size_in_bytes > _retained_size)
+            return false;
+    } while (!_retained_total.compare_exchange_weak(total, total + size_in_bytes));
+    return true;
+}
+
+void ScratchArena::freeBlocks(std::size_t first_block) {
+    for (std::size_t i = first_block; i < _blocks.size(); ++i)
+        ::operator delete(_blocks[i].data, std::align_val_t(alignment));
+    _blocks.resize(std::min(first_block, _blocks.size()));
+}
+
+ScratchScope::ScratchScope() : _arena(ScratchArena::local()), _marker(_arena.mark()) {
+    ++_arena._depth;
+}
+
+ScratchScope::~ScratchScope() {
+    _arena.release(_marker);
+    if (--_arena._depth == 0)
+        _arena.reset();
+}
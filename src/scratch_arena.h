@@ -0,0 +1,112 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_SCRATCH_ARENA_H__
+#define ADVANCED_IMAGE_PROCESSOR_SCRATCH_ARENA_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "image_view.h"
+
+/*
+ * Per-thread bump allocator for the temporaries of the algorithms.
+ *
+ * Memory is taken from the arena of the calling thread while a ScratchScope
+ * is alive and given back all at once when the scope ends. Scopes of a
+ * thread end in the reverse order they began, which holds for tasks a
+ * waiting parallel_for runs in between, as they finish before it returns.
+ *
+ * When the outermost scope of a thread ends, the arena is reset: its blocks
+ * are merged into one block holding the whole peak, so repeating the
+ * operation allocates nothing and reuses memory which is already paged in.
+ * The retained size is one budget shared by the arenas of all threads: an
+ * arena keeps its block only while the blocks kept by all arenas fit in it,
+ * otherwise the block is returned to the system.
+ *
+ * Memory kept for reuse while idle is at most this budget (256 MB) plus the
+ * PixelBufferPool capacity (512 MB) plus the ResultCache capacity (512 MB),
+ * 1.25 GB with the defaults.
+ */
+class ScratchArena {
+public:
+
+    static constexpr std::size_t alignment = 64;
+
+    // arena of the calling thread
+    static ScratchArena &local();
+
+    ScratchArena();
+    ScratchArena(const ScratchArena &other) = delete;
+    ~ScratchArena();
+
+    ScratchArena &operator=(const ScratchArena &other) = delete;
+
+    // uninitialized memory, 64-byte aligned, valid until the innermost scope ends
+    uint8_t *allocate(std::size_t size_in_bytes);
+    template <typename T>
+    T *allocate(std::size_t count) {
+        return reinterpret_cast<T *>(allocate(count * sizeof(T)));
+    }
+    // uninitialized image of packed rows
+    template <typename T, int C>
+    BasicImageView<T, C> allocateImage(int width, int height) {
+        return BasicImageView<T, C>(allocate<T>((std::size_t) width * height * C), width, height);
+    }
+
+    std::size_t getUsed() const;
+    std::size_t getReserved() const;
+
+    // bytes all threads together keep between operations, 256 MB by default
+    static void setRetainedSize(std::size_t size_in_bytes);
+    static std::size_t getRetainedSize();
+
+private:
+    friend class ScratchScope;
+
+    struct Block {
+        uint8_t *data;
+        std::size_t size;
+    };
+
+    struct Marker {
+        std::size_t block;
+        std::size_t offset;
+    };
+
+    Marker mark() const;
+    void release(const Marker &marker);
+    void reset();
+    void freeBlocks(std::size_t first_block);
+    static bool retain(std::size_t size_in_bytes);
+
+    std::vector<Block> _blocks;
+    std::size_t _current_block;
+    std::size_t _offset;
+    int _depth;
+    std::size_t _retained;  // share of the budget held by the kept block
+
+    static std::atomic<std::size_t> _retained_size;
+    static std::atomic<std::size_t> _retained_total;
+};
+
+/*
+ * Lifetime of the scratch memory allocated from the arena of the calling
+ * thread; everything allocated while the scope is alive is freed with it.
+ */
+class ScratchScope {
+public:
+
+    ScratchScope();
+    ScratchScope(const ScratchScope &other) = delete;
+    ~ScratchScope();
+
+    ScratchScope &operator=(const ScratchScope &other) = delete;
+
+    ScratchArena &arena() const { return _arena; }
+
+private:
+    ScratchArena &_arena;
+    ScratchArena::Marker _marker;
+};
+
+#endif // ADVANCED_IMAGE_PROCESSOR_SCRATCH_ARENA_H__
@@ -0,0 +1,78 @@
+#include "texture.h"
+
+#include <GL/gl.h>
+
+#include "image.h"
+
+Texture::Texture() : _texture_id(0), _texture_w(0), _texture_h(0) {}
+
+Texture::~Texture() {
+    release();
+}
+
+void Texture::upload(const Image &image) {
+    // create a OpenGL texture on first use
+    if (_texture_id == 0)
+        glGenTextures(1, &_texture_id);
+
+    // use texture
+    glBindTexture(GL_TEXTURE_2D, _texture_id);
+
+    // setup filtering parameters for display
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // upload pixels into texture
+#if defined(GL_UNPACK_ROW_LENGTH) && !defined(__EMSCRIPTEN__)
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.getImageWidth(), image.getImageHeight(), 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, image.data());
+    _texture_w = image.getImageWidth();
+    _texture_h = image.getImageHeight();
+    _version = image.getVersion();
+}
+
+void Texture::update(const Image &image) {
+    // nothing changed since the last upload
+    if (_texture_id != 0 && image.getVersion() == _version)
+        return;
+
+    // (re)allocate the whole texture for new or resized images
+    if (_texture_id == 0 || _texture_w != image.getImageWidth() || _texture_h != image.getImageHeight()) {
+        if (image.good())
+            upload(image);
+        return;
+    }
+
+    // upload only the modified rows and columns
+    const ImageRect dirty_rect = image.getDirtyRectSince(_version);
+    _version = image.getVersion();
+    if (dirty_rect.empty())
+        return;
+    glBindTexture(GL_TEXTURE_2D, _texture_id);
+#if defined(GL_UNPACK_ROW_LENGTH) && !defined(__EMSCRIPTEN__)
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image.getImageWidth());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, dirty_rect.x, dirty_rect.y, dirty_rect.w, dirty_rect.h,
+            GL_RGBA, GL_UNSIGNED_BYTE, image.pixel(dirty_rect.x, dirty_rect.y));
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#else
+    // without row length support, send whole rows of the dirty band
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, dirty_rect.y, image.getImageWidth(), dirty_rect.h,
+            GL_RGBA, GL_UNSIGNED_BYTE, image.pixel(0, dirty_rect.y));
+#endif
+}
+
+void Texture::release() {
+    if (_texture_id != 0) {
+        glDeleteTextures(1, &_texture_id);
+        _texture_id = 0;
+        _texture_w = 0;
+        _texture_h = 0;
+        _version = {};
+    }
+}
+
+GLuint Texture::getTextureId() const {
+    return _texture_id;
+}
@@ -0,0 +1,29 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_TEXTURE_H__
+#define ADVANCED_IMAGE_PROCESSOR_TEXTURE_H__
+
+#include <GL/gl.h>
+
+#include "image.h"
+
+// OpenGL texture displaying the pixels of an Image, owned by the view side
+class Texture {
+public:
+
+    Texture();
+    Texture(const Texture &other) = delete;
+    ~Texture();
+
+    void upload(const Image &image);
+    // upload what changed since the last upload, if anything
+    void update(const Image &image);
+    void release();
+    GLuint getTextureId() const;
+
+private:
+    GLuint _texture_id;
+    int _texture_w;
+    int _texture_h;
+    ImageVersion _version;
+};
+
+#endif // ADVANCED_IMAGE_PROCESSOR_TEXTURE_H__
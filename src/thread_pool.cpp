@@ -0,0 +1,172 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "progress.h"
+
+// worker index of the calling thread in its pool, -1 for threads outside of a pool
+static thread_local const ThreadPool *current_pool = nullptr;
+static thread_local int current_worker = -1;
+
+ThreadPool &ThreadPool::instance() {
+    static ThreadPool pool(std::max(1, (int) std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+ThreadPool::ThreadPool(int num_workers) : _pending_count(0), _next_queue(0), _stop(false) {
+    for (int i = 0; i < num_workers; ++i)
+        _queues.push_back(std::make_unique<TaskQueue>());
+    for (int i = 0; i < num_workers; ++i)
+        _workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_wake_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (std::thread &worker : _workers)
+        worker.join();
+}
+
+int ThreadPool::getThreadCount() const {
+    return (int) _workers.size() + 1;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    if (_queues.empty()) {
+        task();
+        return;
+    }
+
+    // workers queue their own tasks, other threads spread them over all queues
+    const int queue_index = current_pool == this ? current_worker : (int) (_next_queue++ % _queues.size());
+    {
+        std::lock_guard<std::mutex> lock(_queues[queue_index]->mutex);
+        _queues[queue_index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(_wake_mutex);
+        ++_pending_count;
+    }
+    _wake.notify_one();
+}
+
+bool ThreadPool::runPendingTask() {
+    std::function<void()> task;
+    if (!popTask(current_pool == this ? current_worker : 0, task))
+        return false;
+    task();
+    return true;
+}
+
+bool ThreadPool::popTask(int queue_index, std::function<void()> &task) {
+    if (_queues.empty() || _pending_count == 0)
+        return false;
+
+    // newest task of the own queue
+    {
+        TaskQueue &queue = *_queues[queue_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            --_pending_count;
+            return true;
+        }
+    }
+
+    // steal the oldest task of another queue
+    for (std::size_t i = 1; i < _queues.size(); ++i) {
+        TaskQueue &queue = *_queues[(queue_index + i) % _queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --_pending_count;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int worker_index) {
+    current_pool = this;
+    current_worker = worker_index;
+
+    std::function<void()> task;
+    while (true) {
+        if (popTask(worker_index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_wake_mutex);
+        _wake.wait(lock, [this] { return _stop || _pending_count > 0; });
+        if (_stop)
+            return;
+    }
+}
+
+void parallel_for(int begin, int end, int grain, const std::function<void(int, int)> &body, Progress *progress) {
+    parallel_for_int64(begin, end, grain, [&](int64_t chunk_begin, int64_t chunk_end) {
+        body((int) chunk_begin, (int) chunk_end);
+    }, progress);
+}
+
+void parallel_for_int64(int64_t begin, int64_t end, int64_t grain, const std::function<void(int64_t, int64_t)> &body,
+        Progress *progress) {
+    if (begin >= end)
+        return;
+
+    grain = std::max<int64_t>(grain, 1);
+    const int64_t chunk_count = (end - begin + grain - 1) / grain;
+    ThreadPool &pool = ThreadPool::instance();
+    const int helper_count = (int) std::min<int64_t>(chunk_count, pool.getThreadCount()) - 1;
+    if (helper_count <= 0 && progress == nullptr) {
+        body(begin, end);
+        return;
+    }
+
+    // chunks are claimed by index, helpers starting after all chunks are claimed return without touching body
+    struct State {
+        std::atomic<int64_t> next_chunk = 0;
+        std::atomic<int64_t> done_count = 0;
+    };
+    const std::shared_ptr<State> state = std::make_shared<State>();
+    const auto run_chunks = [state, &body, progress, begin, end, grain, chunk_count] {
+        int64_t chunk;
+        while ((chunk = state->next_chunk++) < chunk_count) {
+            const int64_t chunk_begin = begin + chunk * grain;
+            const int64_t chunk_end = std::min<int64_t>(chunk_begin + grain, end);
+            if (!is_canceled(progress)) {
+                body(chunk_begin, chunk_end);
+                if (progress != nullptr)
+                    progress->advance(chunk_end - chunk_begin);
+            }
+            // the last chunk wakes the calling thread if it is blocked waiting
+            if (state->done_count.fetch_add(1, std::memory_order_release) + 1 == chunk_count)
+                state->done_count.notify_all();
+        }
+    };
+
+    for (int i = 0; i < helper_count; ++i)
+        pool.submit(run_chunks);
+    run_chunks();
+
+    // help with other work until the chunks taken by helpers are done, block when there is none to take
+    int64_t done_count;
+    while ((done_count = state->done_count.load(std::memory_order_acquire)) < chunk_count) {
+        if (!pool.runPendingTask())
+            state->done_count.wait(done_count, std::memory_order_acquire);
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_THREAD_POOL_H__
+#define ADVANCED_IMAGE_PROCESSOR_THREAD_POOL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "progress.h"
+
+/*
+ * Work-stealing thread pool shared by the processing functions.
+ *
+ * Each worker has its own task queue. Tasks submitted from a worker go to
+ * its own queue and are taken from the back (most recent first), idle
+ * workers steal from the front of the other queues.
+ */
+class ThreadPool {
+public:
+
+    // shared pool with one worker less than the number of cores, as the calling thread works too
+    static ThreadPool &instance();
+
+    explicit ThreadPool(int num_workers);
+    ThreadPool(const ThreadPool &other) = delete;
+    ~ThreadPool();
+
+    ThreadPool &operator=(const ThreadPool &other) = delete;
+
+    // number of threads working on a parallel_for, including the calling thread
+    int getThreadCount() const;
+
+    void submit(std::function<void()> task);
+    // run one queued task on the calling thread, false when there was none
+    bool runPendingTask();
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool popTask(int queue_index, std::function<void()> &task);
+    void workerLoop(int worker_index);
+
+    std::vector<std::unique_ptr<TaskQueue>> _queues;
+    std::vector<std::thread> _workers;
+    std::atomic<int> _pending_count;
+    std::atomic<unsigned> _next_queue;
+    std::mutex _wake_mutex;
+    std::condition_variable _wake;
+    bool _stop;
+};
+
+/*
+ * Call body(chunk_begin, chunk_end) for chunks of [begin, end) of at least
+ * grain indices on the shared pool, and return when all chunks are done.
+ * The calling thread takes chunks too, and runs other queued tasks while it
+ * waits, so parallel_for can be nested.
+ *
+ * With a progress, every finished index is reported to it and no more
+ * chunks are started once it is canceled.
+ */
+void parallel_for(int begin, int end, int grain, const std::function<void(int, int)> &body, Progress *progress=nullptr);
+// the same over 64-bit indices, e.g. the tiles of a TiledImage
+void parallel_for_int64(int64_t begin, int64_t end, int64_t grain, const std::function<void(int64_t, int64_t)> &body,
+        Progress *progress=nullptr);
+
+// bands of rows of an image, at least a few thousand pixels each: body(y_begin, y_end)
+template <typename F>
+void parallel_for_rows(int width, int height, F &&body, Progress *progress=nullptr) {
+    constexpr int min_band_pixels = 16384;
+    const int min_rows = std::max(1, min_band_pixels / std::max(width, 1));
+    const int balanced_rows = height / (4 * ThreadPool::instance().getThreadCount());
+    parallel_for(0, height, std::max(min_rows, balanced_rows), body, progress);
+}
+
+// 2D tiles of tile_width x tile_height pixels covering an image, clipped at the borders: body(x, y, w, h)
+template <typename F>
+void parallel_for_tiles(int width, int height, int tile_width, int tile_height, F &&body, Progress *progress=nullptr) {
+    const int tile_count_x = (width + tile_width - 1) / tile_width;
+    const int tile_count_y = (height + tile_height - 1) / tile_height;
+    parallel_for(0, tile_count_x * tile_count_y, 1, [&](int tile_begin, int tile_end) {
+        for (int tile = tile_begin; tile < tile_end; ++tile) {
+            const int x = tile % tile_count_x * tile_width;
+            const int y = tile / tile_count_x * tile_height;
+            body(x, y, std::min(tile_width, width - x), std::min(tile_height, height - y));
+        }
+    }, progress);
+}
+
+#endif // ADVANCED_IMAGE_PROCESSOR_THREAD_POOL_H__
@@ -0,0 +1,347 @@
+#include "tile_pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "algorithms.h"
+#include "image.h"
+#include "image_view.h"
+#include "pixel_kernels.h"
+#include "progress.h"
+#include "scratch_arena.h"
+#include "thread_pool.h"
+#include "utility.h"
+
+// pixels of a region of the image, with the image coordinates of its top-left pixel
+struct RegionView {
+    ConstImageView view;
+    int x;
+    int y;
+};
+
+// separable convolution of a region, the horizontal pass over input rows gathered through the columns
+static void convolve_region_separable(const RegionView &in, ImageView out, int out_x, int out_y, int image_h,
+        const int *columns, int kernel_size, const float *column, const float *row,
+        ConvolutionEdgeHandlingMethod edge_handling_method) {
+    const int half_kernel_size = kernel_size / 2;
+    const int column_count = out.getImageWidth() + 2 * half_kernel_size;
+    const int row_values = out.getImageWidth() * 4;
+    const int sum_rows = out.getImageHeight() + 2 * half_kernel_size;
+    const PixelKernels &kernels = get_pixel_kernels();
+
+    ScratchScope scratch;
+    float *column_weights = scratch.arena().allocate<float>(kernel_size);
+    float *row_weights = scratch.arena().allocate<float>(kernel_size);
+    std::reverse_copy(column, column + kernel_size, column_weights);
+    std::reverse_copy(row, row + kernel_size, row_weights);
+    uint8_t *padded_row = scratch.arena().allocate<uint8_t>((std::size_t) column_count * 4);
+    float *sums = scratch.arena().allocate<float>((std::size_t) sum_rows * row_values);
+    const float **rows = scratch.arena().allocate<const float *>(kernel_size);
+
+    for (int i = 0; i < sum_rows; ++i) {
+        const uint8_t *in_row = in.view.row(
+                (int) map_edge_coordinate(out_y - half_kernel_size + i, image_h, edge_handling_method) - in.y);
+        for (int x = 0; x < column_count; ++x)
+            std::memcpy(padded_row + x * 4, in_row + columns[x] * 4, 4);
+        kernels.convolve_horizontal(padded_row, 4, kernel_size, row_weights, sums + (std::ptrdiff_t) i * row_values,
+                row_values);
+    }
+
+    for (int y = 0; y < out.getImageHeight(); ++y) {
+        for (int i = 0; i < kernel_size; ++i)
+            rows[i] = sums + (std::ptrdiff_t) (y + i) * row_values;
+        uint8_t *out_row = out.row(y);
+        kernels.convolve_vertical(rows, kernel_size, column_weights, out_row, row_values);
+
+        const uint8_t *in_row = in.view.row(out_y + y - in.y);
+        for (int x = 0; x < out.getImageWidth(); ++x)
+            out_row[x * 4 + Image::A] = in_row[(out_x + x - in.x) * 4 + Image::A];  // preserve original alpha channel
+    }
+}
+
+/*
+ * Convolve the color channels of the region of the image at (out_x, out_y)
+ * reading the input region, which must hold every pixel read after edge
+ * handling. Same pixel kernels as image_convolution, which runs separable
+ * kernels (column and row given) as two passes as well.
+ */
+static void convolve_region(const RegionView &in, ImageView out, int out_x, int out_y, int image_w, int image_h,
+        int kernel_size, const float *kernel, const float *column, const float *row,
+        ConvolutionEdgeHandlingMethod edge_handling_method) {
+    const int half_kernel_size = kernel_size / 2;
+
+    // input columns read for the output columns, after edge handling
+    ScratchScope scratch;
+    const int column_count = out.getImageWidth() + 2 * half_kernel_size;
+    int *columns = scratch.arena().allocate<int>(column_count);
+    for (int i = 0; i < column_count; ++i)
+        columns[i] = (int) map_edge_coordinate(out_x - half_kernel_size + i, image_w, edge_handling_method) - in.x;
+
+    if (column != nullptr) {
+        convolve_region_separable(in, out, out_x, out_y, image_h, columns, kernel_size, column, row, edge_handling_method);
+        return;
+    }
+
+    // input rows of the taps, output row y reading rows y to y + kernel_size - 1
+    const int out_w = out.getImageWidth();
+    const int tap_row_count = out.getImageHeight() + 2 * half_kernel_size;
+    const uint8_t **in_rows = scratch.arena().allocate<const uint8_t *>(tap_row_count);
+    for (int i = 0; i < tap_row_count; ++i) {
+        in_rows[i] = in.view.row(
+                (int) map_edge_coordinate(out_y - half_kernel_size + i, image_h, edge_handling_method) - in.y);
+    }
+
+    // output columns [interior_begin, interior_end) read their taps straight from the input rows, the ones near
+    // the image edges read taps gathered through the columns
+    const int interior_begin = std::clamp(half_kernel_size - out_x, 0, out_w);
+    const int interior_end = std::clamp(image_w - half_kernel_size - out_x, interior_begin, out_w);
+    const std::pair<int, int> border_ranges[2] = {{0, interior_begin}, {interior_end, out_w}};
+
+    // the weights in the order of the taps, the kernel flipped
+    float *weights = scratch.arena().allocate<float>(kernel_size * kernel_size);
+    std::reverse_copy(kernel, kernel + kernel_size * kernel_size, weights);
+    const uint8_t **rows = scratch.arena().allocate<const uint8_t *>(kernel_size);
+    uint8_t *taps = scratch.arena().allocate<uint8_t>((std::size_t) kernel_size * column_count * 4);
+    const PixelKernels &kernels = get_pixel_kernels();
+
+    for (int y = 0; y < out.getImageHeight(); ++y) {
+        const uint8_t *in_row = in.view.row(out_y + y - in.y) + (out_x - in.x) * 4;
+        uint8_t *out_row = out.row(y);
+        // preserve original alpha channel
+        if (interior_begin < interior_end) {
+            for (int i = 0; i < kernel_size; ++i)
+                rows[i] = in_rows[y + i] + (out_x + interior_begin - half_kernel_size - in.x) * 4;
+            kernels.convolve_row(rows, kernel_size, weights, in_row + interior_begin * 4, out_row + interior_begin * 4,
+                    interior_end - interior_begin);
+        }
+
+        for (const auto &[x_begin, x_end] : border_ranges) {
+            if (x_begin == x_end)
+                continue;
+            const int tap_count = x_end - x_begin + 2 * half_kernel_size;
+            for (int i = 0; i < kernel_size; ++i) {
+                uint8_t *tap_row = taps + (std::size_t) i * column_count * 4;
+                for (int x = 0; x < tap_count; ++x)
+                    std::memcpy(tap_row + x * 4, in_rows[y + i] + columns[x_begin + x] * 4, 4);
+                rows[i] = tap_row;
+            }
+            kernels.convolve_row(rows, kernel_size, weights, in_row + x_begin * 4, out_row + x_begin * 4,
+                    x_end - x_begin);
+        }
+    }
+}
+
+void TilePipeline::addConvolution(int kernel_size, const float *kernel, ConvolutionEdgeHandlingMethod edge_handling_method) {
+    Stage stage = {};
+    stage.type = Stage::CONVOLUTION;
+    stage.kernel_size = kernel_size;
+    stage.kernel.assign(kernel, kernel + kernel_size * kernel_size);
+    stage.column.resize(kernel_size);
+    stage.row.resize(kernel_size);
+    stage.separable = kernel_size >= min_separable_kernel_size &&
+            factor_separable_kernel(kernel_size, kernel, stage.column.data(), stage.row.data());
+    stage.edge_handling_method = edge_handling_method;
+    _stages.push_back(std::move(stage));
+}
+
+void TilePipeline::addLookupTable(const uint8_t *lut) {
+    Stage stage = {};
+    stage.type = Stage::LOOKUP_TABLE;
+    std::memcpy(stage.lut, lut, sizeof(stage.lut));
+    _stages.push_back(std::move(stage));
+}
+
+void TilePipeline::addHistogramEqualization() {
+    Stage stage = {};
+    stage.type = Stage::HISTOGRAM_EQUALIZATION;
+    _stages.push_back(std::move(stage));
+}
+
+bool TilePipeline::empty() const {
+    return _stages.empty();
+}
+
+bool TilePipeline::runsWholeImage(const Stage &stage, int width, int height) const {
+    return stage.type == Stage::CONVOLUTION &&
+            convolution_uses_fft(width, height, stage.kernel_size, stage.kernel.data());
+}
+
+bool TilePipeline::isWholeImageSegment(std::size_t begin, std::size_t end, int width, int height) const {
+    return end - begin == 1 &&
+            (_stages[begin].type == Stage::HISTOGRAM_EQUALIZATION || runsWholeImage(_stages[begin], width, height));
+}
+
+std::size_t TilePipeline::findSegmentEnd(std::size_t begin, int width, int height) const {
+    // a convolution in the frequency domain is a segment of its own
+    if (runsWholeImage(_stages[begin], width, height))
+        return begin + 1;
+
+    // a segment ends after a histogram equalization or before a WRAP convolution, which can't read its halo from the
+    // tile, or a convolution in the frequency domain
+    std::size_t end = begin;
+    while (end < _stages.size()) {
+        const Stage &stage = _stages[end];
+        if (end > begin && stage.type == Stage::CONVOLUTION &&
+                (stage.edge_handling_method == ConvolutionEdgeHandlingMethod::WRAP || runsWholeImage(stage, width, height)))
+            break;
+        ++end;
+        if (stage.type == Stage::HISTOGRAM_EQUALIZATION)
+            break;
+    }
+    return end;
+}
+
+void TilePipeline::run(ConstImageView image, ImageView out_image, Progress *progress) const {
+    if (_stages.empty()) {
+        copy_pixels(image, out_image);
+        return;
+    }
+
+    // the tiles of every segment, and the rows mapped by histogram equalizations; whole image passes add their own
+    const int image_w = image.getImageWidth();
+    const int image_h = image.getImageHeight();
+    if (progress != nullptr) {
+        const int tile_count = ((image_w + tile_width - 1) / tile_width) * ((image_h + tile_height - 1) / tile_height);
+        for (std::size_t begin = 0, end; begin < _stages.size(); begin = end) {
+            end = findSegmentEnd(begin, image_w, image_h);
+            if (isWholeImageSegment(begin, end, image_w, image_h))
+                continue;
+            progress->addTotal(tile_count);
+            if (_stages[end - 1].type == Stage::HISTOGRAM_EQUALIZATION)
+                progress->addTotal(image_h);
+        }
+    }
+
+    // segments after the first read the output of the previous one, a copy of it when they read halos
+    ScratchScope scratch;
+    ImageView segment_input;
+    for (std::size_t begin = 0, end; begin < _stages.size() && !is_canceled(progress); begin = end) {
+        end = findSegmentEnd(begin, image_w, image_h);
+        if (begin == 0) {
+            runSegment(image, out_image, begin, end, progress);
+            continue;
+        }
+
+        const bool reads_halo = std::any_of(_stages.begin() + begin, _stages.begin() + end,
+                [](const Stage &stage) { return stage.type == Stage::CONVOLUTION; });
+        if (reads_halo) {
+            if (segment_input.empty())
+                segment_input = scratch.arena().allocateImage<uint8_t, 4>(out_image.getImageWidth(), out_image.getImageHeight());
+            copy_pixels(ConstImageView(out_image), segment_input);
+            runSegment(segment_input, out_image, begin, end, progress);
+        } else {
+            runSegment(out_image, out_image, begin, end, progress);
+        }
+    }
+}
+
+std::shared_ptr<Image> TilePipeline::run(const std::shared_ptr<Image> image, Progress *progress) const {
+    std::shared_ptr<Image> result = std::make_shared<Image>(
+            image->getImageWidth(), image->getImageHeight(), Image::INIT_UNINITIALIZED);
+    run(std::as_const(*image).view(), result->view(), progress);
+    return is_canceled(progress) ? nullptr : result;
+}
+
+void TilePipeline::runSegment(ConstImageView image, ImageView out_image, std::size_t begin, std::size_t end,
+        Progress *progress) const {
+    const int image_w = image.getImageWidth();
+    const int image_h = image.getImageHeight();
+    if (isWholeImageSegment(begin, end, image_w, image_h)) {
+        const Stage &stage = _stages[begin];
+        if (stage.type == Stage::HISTOGRAM_EQUALIZATION) {
+            histogram_equalization(image, out_image, progress);
+        } else {
+            image_convolution(image, out_image, stage.kernel_size, stage.kernel.data(), stage.edge_handling_method,
+                    progress);
+        }
+        return;
+    }
+
+    const bool equalize = _stages[end - 1].type == Stage::HISTOGRAM_EQUALIZATION;
+
+    // halo still needed after each stage, by the convolutions following it
+    std::vector<int> halos(end - begin + 1, 0);
+    for (std::size_t i = end; i-- > begin; ) {
+        const Stage &stage = _stages[i];
+        halos[i - begin] = halos[i - begin + 1] + (stage.type == Stage::CONVOLUTION ? stage.kernel_size / 2 : 0);
+    }
+
+    int64_t histogram[256] = {};
+    std::mutex histogram_mutex;
+
+    parallel_for_tiles(image_w, image_h, tile_width, tile_height, [&](int tile_x, int tile_y, int tile_w, int tile_h) {
+        // the stages ping-pong between two buffers, the first stage reads the image and the last writes the output;
+        // both hold the largest region, the tile with the halo after the first stage
+        ScratchScope scratch;
+        const std::size_t buffer_size = (std::size_t) (tile_w + 2 * halos[1]) * (tile_h + 2 * halos[1]) * 4;
+        uint8_t *const buffers[2] = {
+            end - begin > 1 ? scratch.arena().allocate<uint8_t>(buffer_size) : nullptr,
+            end - begin > 2 ? scratch.arena().allocate<uint8_t>(buffer_size) : nullptr,
+        };
+        int next_buffer = 0;
+        RegionView current = {image, 0, 0};
+
+        for (std::size_t i = begin; i < end; ++i) {
+            const Stage &stage = _stages[i];
+            if (stage.type == Stage::HISTOGRAM_EQUALIZATION)
+                break;
+
+            // output region of the stage: the tile and the halo of the following stages, inside the image
+            const int halo = halos[i - begin + 1];
+            const int x0 = std::max(tile_x - halo, 0);
+            const int y0 = std::max(tile_y - halo, 0);
+            const int x1 = std::min(tile_x + tile_w + halo, image_w);
+            const int y1 = std::min(tile_y + tile_h + halo, image_h);
+
+            ImageView out_region;
+            const bool is_last = i + 1 == end || (i + 2 == end && equalize);
+            if (is_last) {
+                out_region = out_image.subview(tile_x, tile_y, tile_w, tile_h);
+            } else {
+                out_region = ImageView(buffers[next_buffer], x1 - x0, y1 - y0);
+                next_buffer = 1 - next_buffer;
+            }
+
+            if (stage.type == Stage::CONVOLUTION) {
+                convolve_region(current, out_region, x0, y0, image_w, image_h,
+                        stage.kernel_size, stage.kernel.data(), stage.separable ? stage.column.data() : nullptr,
+                        stage.row.data(), stage.edge_handling_method);
+            } else {
+                apply_lookup_table(current.view.subview(x0 - current.x, y0 - current.y, x1 - x0, y1 - y0), out_region,
+                        stage.lut);
+            }
+            current = {out_region, x0, y0};
+        }
+
+        if (equalize) {
+            int64_t tile_histogram[256] = {};
+            const ConstImageView out_tile = out_image.subview(tile_x, tile_y, tile_w, tile_h);
+            for (int y = 0; y < tile_h; ++y) {
+                const uint8_t *row = out_tile.row(y);
+                for (int x = 0; x < tile_w; ++x)
+                    ++tile_histogram[row[x * 4 + Image::R]];
+            }
+            std::lock_guard<std::mutex> lock(histogram_mutex);
+            for (int g = 0; g < 256; ++g)
+                histogram[g] += tile_histogram[g];
+        }
+    }, progress);
+
+    if (!equalize || is_canceled(progress))
+        return;
+
+    // map the whole output with the histogram of all tiles
+    uint8_t transform_map[256] = {};
+    compute_equalization_map(histogram, transform_map);
+    parallel_for_rows(image_w, image_h, [&](int y_begin, int y_end) {
+        apply_lookup_table(ConstImageView(out_image).subview(0, y_begin, image_w, y_end - y_begin),
+                out_image.subview(0, y_begin, image_w, y_end - y_begin), transform_map);
+    }, progress);
+}
@@ -0,0 +1,72 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_TILE_PIPELINE_H__
+#define ADVANCED_IMAGE_PROCESSOR_TILE_PIPELINE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "algorithms.h"
+#include "image.h"
+#include "image_view.h"
+#include "progress.h"
+
+/*
+ * Chain of operations run tile by tile.
+ *
+ * The image is split into tiles small enough for the pixels of all stages
+ * to stay in the L2 cache, wide ones so their rows stream through the row
+ * kernels like whole rows do. Each tile goes through the whole chain together
+ * with the halo of pixels its neighborhood operations read, so the source
+ * is read from memory about once and no intermediate images are made.
+ * Histogram equalization needs the histogram of the whole image: it is
+ * collected while the tiles are written, and the mapping is applied in one
+ * more pass over the output.
+ *
+ * Results are the same as running the operations one after another on
+ * whole images. Only a WRAP convolution after the first stage reads pixels
+ * from the far side of the image, the chain is split into separate passes
+ * in front of it. Convolutions image_convolution runs in the frequency
+ * domain, with its tiling and rounding, and histogram equalizations alone in
+ * their segment run as whole-image passes of their own.
+ */
+class TilePipeline {
+public:
+
+    static constexpr int tile_width = 1024;
+    static constexpr int tile_height = 32;
+
+    void addConvolution(int kernel_size, const float *kernel,
+            ConvolutionEdgeHandlingMethod edge_handling_method=ConvolutionEdgeHandlingMethod::EXTEND);
+    void addLookupTable(const uint8_t *lut);
+    void addHistogramEqualization();
+    bool empty() const;
+
+    // out_image has the size of image and must not overlap it
+    void run(ConstImageView image, ImageView out_image, Progress *progress=nullptr) const;
+    std::shared_ptr<Image> run(const std::shared_ptr<Image> image, Progress *progress=nullptr) const;
+
+private:
+    struct Stage {
+        enum Type { CONVOLUTION, LOOKUP_TABLE, HISTOGRAM_EQUALIZATION };
+
+        Type type;
+        int kernel_size;
+        std::vector<float> kernel;
+        // rank-1 factors of the kernel, when it is separable
+        bool separable;
+        std::vector<float> column;
+        std::vector<float> row;
+        ConvolutionEdgeHandlingMethod edge_handling_method;
+        uint8_t lut[256];
+    };
+
+    bool runsWholeImage(const Stage &stage, int width, int height) const;
+    bool isWholeImageSegment(std::size_t begin, std::size_t end, int width, int height) const;
+    std::size_t findSegmentEnd(std::size_t begin, int width, int height) const;
+    void runSegment(ConstImageView image, ImageView out_image, std::size_t begin, std::size_t end, Progress *progress) const;
+
+    std::vector<Stage> _stages;
+};
+
+#endif // ADVANCED_IMAGE_PROCESSOR_TILE_PIPELINE_H__
@@ -0,0 +1,132 @@
+#include "tiled_image.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "image.h"
+#include "image_view.h"
+#include "pixel_buffer.h"
+
+static constexpr std::size_t tile_stride = 4 * TiledImage::tile_size;
+static constexpr std::size_t tile_size_in_bytes = tile_stride * TiledImage::tile_size;
+
+TiledImage::TiledImage() : _image_w(0), _image_h(0), _tile_count_x(0), _tile_count_y(0) {}
+
+TiledImage::TiledImage(int64_t width, int64_t height, Image::InitMode init_mode) : TiledImage() {
+    init(width, height, init_mode);
+}
+
+void TiledImage::init(int64_t width, int64_t height, Image::InitMode init_mode) {
+    close();
+
+    _image_w = width;
+    _image_h = height;
+    _tile_count_x = (width + tile_size - 1) / tile_size;
+    _tile_count_y = (height + tile_size - 1) / tile_size;
+
+    // every tile is allocated at full size, so all of them share one size class of the pool
+    _tiles.reserve((std::size_t) _tile_count_x * _tile_count_y);
+    for (int64_t i = 0; i < _tile_count_x * _tile_count_y; ++i) {
+        _tiles.emplace_back(tile_size_in_bytes);
+        if (init_mode == Image::INIT_WHITE)
+            memset(_tiles.back().data(), 255, tile_size_in_bytes);
+    }
+}
+
+void TiledImage::close() {
+    _tiles.clear();
+    _image_w = 0;
+    _image_h = 0;
+    _tile_count_x = 0;
+    _tile_count_y = 0;
+}
+
+bool TiledImage::good() const {
+    return !_tiles.empty();
+}
+
+bool TiledImage::loadFromFile(const std::string &filepath) {
+    // a mapped file is only paged in as its tiles are copied, so it never needs the memory of the whole image twice
+    Image image;
+    if (!image.mapRawFile(filepath) && !image.loadFromFile(filepath))
+        return false;
+
+    init(image.getImageWidth(), image.getImageHeight(), Image::INIT_UNINITIALIZED);
+    parallelForEachTile([&](ImageView tile, int64_t x, int64_t y) {
+        copy_pixels(std::as_const(image).view((int) x, (int) y, tile.getImageWidth(), tile.getImageHeight()), tile);
+    });
+    return true;
+}
+
+int64_t TiledImage::getImageWidth() const {
+    return _image_w;
+}
+
+int64_t TiledImage::getImageHeight() const {
+    return _image_h;
+}
+
+int64_t TiledImage::getTileCountX() const {
+    return _tile_count_x;
+}
+
+int64_t TiledImage::getTileCountY() const {
+    return _tile_count_y;
+}
+
+ImageView TiledImage::tile(int64_t tile_x, int64_t tile_y) {
+    const int width = (int) std::min<int64_t>(tile_size, _image_w - tile_x * tile_size);
+    const int height = (int) std::min<int64_t>(tile_size, _image_h - tile_y * tile_size);
+    return ImageView(_tiles[(std::size_t) tile_y * _tile_count_x + tile_x].data(), width, height, tile_stride);
+}
+
+ConstImageView TiledImage::tile(int64_t tile_x, int64_t tile_y) const {
+    const int width = (int) std::min<int64_t>(tile_size, _image_w - tile_x * tile_size);
+    const int height = (int) std::min<int64_t>(tile_size, _image_h - tile_y * tile_size);
+    return ConstImageView(_tiles[(std::size_t) tile_y * _tile_count_x + tile_x].data(), width, height, tile_stride);
+}
+
+uint8_t *TiledImage::pixel(int64_t x, int64_t y) {
+    return tile(x / tile_size, y / tile_size).pixel((int) (x % tile_size), (int) (y % tile_size));
+}
+
+const uint8_t *TiledImage::pixel(int64_t x, int64_t y) const {
+    return tile(x / tile_size, y / tile_size).pixel((int) (x % tile_size), (int) (y % tile_size));
+}
+
+void TiledImage::readRegion(int64_t x, int64_t y, ImageView out_region) const {
+    // copy the overlapping part of every tile touched by the region
+    for (int64_t region_y = 0; region_y < out_region.getImageHeight(); ) {
+        const int64_t image_y = y + region_y;
+        const int rows = (int) std::min<int64_t>(tile_size - image_y % tile_size, out_region.getImageHeight() - region_y);
+        for (int64_t region_x = 0; region_x < out_region.getImageWidth(); ) {
+            const int64_t image_x = x + region_x;
+            const int columns = (int) std::min<int64_t>(tile_size - image_x % tile_size, out_region.getImageWidth() - region_x);
+            const ConstImageView tile_part = tile(image_x / tile_size, image_y / tile_size)
+                    .subview((int) (image_x % tile_size), (int) (image_y % tile_size), columns, rows);
+            copy_pixels(tile_part, out_region.subview((int) region_x, (int) region_y, columns, rows));
+            region_x += columns;
+        }
+        region_y += rows;
+    }
+}
+
+void TiledImage::writeRegion(int64_t x, int64_t y, ConstImageView region) {
+    for (int64_t region_y = 0; region_y < region.getImageHeight(); ) {
+        const int64_t image_y = y + region_y;
+        const int rows = (int) std::min<int64_t>(tile_size - image_y % tile_size, region.getImageHeight() - region_y);
+        for (int64_t region_x = 0; region_x < region.getImageWidth(); ) {
+            const int64_t image_x = x + region_x;
+            const int columns = (int) std::min<int64_t>(tile_size - image_x % tile_size, region.getImageWidth() - region_x);
+            const ImageView tile_part = tile(image_x / tile_size, image_y / tile_size)
+                    .subview((int) (image_x % tile_size), (int) (image_y % tile_size), columns, rows);
+            copy_pixels(region.subview((int) region_x, (int) region_y, columns, rows), tile_part);
+            region_x += columns;
+        }
+        region_y += rows;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_TILED_IMAGE_H__
+#define ADVANCED_IMAGE_PROCESSOR_TILED_IMAGE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "image.h"
+#include "image_view.h"
+#include "pixel_buffer.h"
+#include "progress.h"
+#include "thread_pool.h"
+
+/*
+ * RGBA image stored as separately allocated square tiles.
+ *
+ * Sizes and coordinates are 64-bit, and no allocation is larger than one
+ * tile, so images far beyond the size of a single contiguous buffer can be
+ * held and processed tile by tile. Tiles on the right and bottom edges are
+ * clipped to the image size, but still allocated at the full 256 x 256
+ * pixels, so all tiles share one size class of the PixelBufferPool.
+ *
+ * Only raw pixel files are loaded tile by tile. Other formats are decoded
+ * into one contiguous Image first, so they are limited to the sizes an
+ * Image can hold and need the memory of the whole image twice while they
+ * are copied into tiles.
+ */
+class TiledImage {
+public:
+
+    static constexpr int tile_size = 256;
+
+    TiledImage();
+    TiledImage(int64_t width, int64_t height, Image::InitMode init_mode=Image::INIT_WHITE);
+    TiledImage(const TiledImage &other) = delete;
+    TiledImage(TiledImage &&other) noexcept = default;
+
+    TiledImage &operator=(const TiledImage &other) = delete;
+    TiledImage &operator=(TiledImage &&other) noexcept = default;
+
+    void init(int64_t width, int64_t height, Image::InitMode init_mode=Image::INIT_WHITE);
+    void close();
+    bool good() const;
+
+    // raw pixel files (see Image::mapRawFile) are mapped and copied tile by tile, other files are decoded first
+    bool loadFromFile(const std::string &filepath);
+
+    int64_t getImageWidth() const;
+    int64_t getImageHeight() const;
+    int64_t getTileCountX() const;
+    int64_t getTileCountY() const;
+
+    ImageView tile(int64_t tile_x, int64_t tile_y);
+    ConstImageView tile(int64_t tile_x, int64_t tile_y) const;
+    uint8_t *pixel(int64_t x, int64_t y);
+    const uint8_t *pixel(int64_t x, int64_t y) const;
+
+    // copy between a region of this image, with its top-left corner at (x, y), and a view
+    void readRegion(int64_t x, int64_t y, ImageView out_region) const;
+    void writeRegion(int64_t x, int64_t y, ConstImageView region);
+
+    // call f(tile view, x of the tile, y of the tile) for every tile in row-major order
+    template <typename F>
+    void forEachTile(F f) {
+        for (int64_t tile_y = 0; tile_y < _tile_count_y; ++tile_y)
+            for (int64_t tile_x = 0; tile_x < _tile_count_x; ++tile_x)
+                f(tile(tile_x, tile_y), tile_x * tile_size, tile_y * tile_size);
+    }
+
+    template <typename F>
+    void forEachTile(F f) const {
+        for (int64_t tile_y = 0; tile_y < _tile_count_y; ++tile_y)
+            for (int64_t tile_x = 0; tile_x < _tile_count_x; ++tile_x)
+                f(tile(tile_x, tile_y), tile_x * tile_size, tile_y * tile_size);
+    }
+
+    // like forEachTile, but tiles are processed in any order on the thread pool, each tile is a unit of the progress
+    template <typename F>
+    void parallelForEachTile(F f, Progress *progress=nullptr) {
+        parallel_for_int64(0, _tile_count_x * _tile_count_y, 1, [&](int64_t tile_begin, int64_t tile_end) {
+            for (int64_t tile = tile_begin; tile < tile_end; ++tile)
+                f(this->tile(tile % _tile_count_x, tile / _tile_count_x),
+                        tile % _tile_count_x * tile_size, tile / _tile_count_x * tile_size);
+        }, progress);
+    }
+
+    template <typename F>
+    void parallelForEachTile(F f, Progress *progress=nullptr) const {
+        parallel_for_int64(0, _tile_count_x * _tile_count_y, 1, [&](int64_t tile_begin, int64_t tile_end) {
+            for (int64_t tile = tile_begin; tile < tile_end; ++tile)
+                f(this->tile(tile % _tile_count_x, tile / _tile_count_x),
+                        tile % _tile_count_x * tile_size, tile / _tile_count_x * tile_size);
+        }, progress);
+    }
+
+private:
+    int64_t _image_w;
+    int64_t _image_h;
+    int64_t _tile_count_x;
+    int64_t _tile_count_y;
+    std::vector<PixelBuffer> _tiles;
+};
+
+#endif // ADVANCED_IMAGE_PROCESSOR_TILED_IMAGE_H__
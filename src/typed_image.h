@@ -0,0 +1,188 @@
+#ifndef ADVANCED_IMAGE_PROCESSOR_TYPED_IMAGE_H__
+#define ADVANCED_IMAGE_PROCESSOR_TYPED_IMAGE_H__
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "image.h"
+#include "image_view.h"
+#include "pixel_buffer.h"
+#include "pixel_kernels.h"
+
+/*
+ * Pixel formats
+ *
+ * Integer channels span [0, max value of the type], float channels span
+ * [0, 1] but are never clamped, so float intermediates keep values out of
+ * range and their full precision between processing stages.
+ */
+
+template <typename T>
+struct ChannelTraits;
+
+template <>
+struct ChannelTraits<uint8_t> {
+    static constexpr float max_value = 255.f;
+};
+
+template <>
+struct ChannelTraits<uint16_t> {
+    static constexpr float max_value = 65535.f;
+};
+
+template <>
+struct ChannelTraits<float> {
+    static constexpr float max_value = 1.f;
+};
+
+template <typename T>
+constexpr T channel_from_float(float value) {
+    if constexpr (std::is_floating_point_v<T>) {
+        return value;
+    } else {
+        const float rounded = std::round(value);
+        return rounded < 0.f ? 0 : rounded > ChannelTraits<T>::max_value ? (T) ChannelTraits<T>::max_value : (T) rounded;
+    }
+}
+
+/*
+ * Image with a compile-time pixel format: T is the channel type and C the
+ * number of interleaved channels (1 for gray, 4 for RGBA).
+ */
+template <typename T, int C>
+class TypedImage {
+public:
+
+    using value_type = T;
+    static constexpr int channels = C;
+    using View = BasicImageView<T, C>;
+    using ConstView = BasicImageView<const T, C>;
+
+    TypedImage() : _image_w(0), _image_h(0) {}
+
+    TypedImage(int width, int height, Image::InitMode init_mode=Image::INIT_WHITE) : TypedImage() {
+        init(width, height, init_mode);
+    }
+
+    TypedImage(const TypedImage &other) : TypedImage(other._image_w, other._image_h, Image::INIT_UNINITIALIZED) {
+        if (other.good())
+            std::memcpy(_buffer.data(), other._buffer.data(), sizeInBytes());
+    }
+
+    TypedImage(TypedImage &&other) noexcept :
+            _image_w(std::exchange(other._image_w, 0)), _image_h(std::exchange(other._image_h, 0)),
+            _buffer(std::move(other._buffer)) {}
+
+    TypedImage &operator=(TypedImage other) noexcept {
+        std::swap(_image_w, other._image_w);
+        std::swap(_image_h, other._image_h);
+        std::swap(_buffer, other._buffer);
+        return *this;
+    }
+
+    void init(int width, int height, Image::InitMode init_mode=Image::INIT_WHITE) {
+        _image_w = width;
+        _image_h = height;
+        _buffer = PixelBuffer(sizeInBytes());
+
+        // white with opaque alpha
+        if (init_mode == Image::INIT_WHITE) {
+            T *data = this->data();
+            const std::size_t count = (std::size_t) _image_w * _image_h * C;
+            for (std::size_t i = 0; i < count; ++i)
+                data[i] = (T) ChannelTraits<T>::max_value;
+        }
+    }
+
+    void close() {
+        _buffer.release();
+        _image_w = 0;
+        _image_h = 0;
+    }
+
+    bool good() const { return _buffer.data() != nullptr; }
+    int getImageWidth() const { return _image_w; }
+    int getImageHeight() const { return _image_h; }
+    std::size_t sizeInBytes() const { return (std::size_t) _image_w * _image_h * C * sizeof(T); }
+
+    T *data() { return reinterpret_cast<T *>(_buffer.data()); }
+    const T *data() const { return reinterpret_cast<const T *>(_buffer.data()); }
+    T *pixel(int x, int y) { return data() + ((std::size_t) y * _image_w + x) * C; }
+    const T *pixel(int x, int y) const { return data() + ((std::size_t) y * _image_w + x) * C; }
+
+    View view() { return View(data(), _image_w, _image_h); }
+    ConstView view() const { return ConstView(data(), _image_w, _image_h); }
+
+    bool resize(int width, int height) {
+        static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, float>, "resize supports uint8 and float channels");
+        if (width <= 0 || height <= 0)
+            return false;
+
+        TypedImage resized(width, height, Image::INIT_UNINITIALIZED);
+        bool result;
+        if constexpr (std::is_same_v<T, uint8_t>)
+            result = get_pixel_kernels().resize(data(), _image_w, _image_h, 0, resized.data(), width, height, 0, C);
+        else
+            result = get_pixel_kernels().resize_float(data(), _image_w, _image_h, 0, resized.data(), width, height, 0, C);
+
+        if (!result)
+            return false;
+        *this = std::move(resized);
+        return true;
+    }
+
+private:
+    int _image_w;
+    int _image_h;
+    PixelBuffer _buffer;
+};
+
+using Gray8Image = TypedImage<uint8_t, 1>;
+using RGBA8Image = TypedImage<uint8_t, 4>;
+using RGBA16Image = TypedImage<uint16_t, 4>;
+using Gray32FImage = TypedImage<float, 1>;
+using RGBA32FImage = TypedImage<float, 4>;
+
+using Gray8View = BasicImageView<uint8_t, 1>;
+using ConstGray8View = BasicImageView<const uint8_t, 1>;
+using Gray32FView = BasicImageView<float, 1>;
+using ConstGray32FView = BasicImageView<const float, 1>;
+
+/*
+ * Convert pixels between formats of views with the same size.
+ *
+ * Channel values are rescaled to the destination range. Gray to RGBA
+ * replicates the level with opaque alpha, RGBA to gray averages R, G and B
+ * (like to_gray_average) and drops alpha.
+ */
+template <typename TS, int CS, typename TD, int CD>
+void convert_pixels(const BasicImageView<const TS, CS> &src, const BasicImageView<TD, CD> &dst) {
+    static_assert((CS == 1 || CS == 4) && (CD == 1 || CD == 4), "only gray and RGBA formats are supported");
+    constexpr float scale = ChannelTraits<TD>::max_value / ChannelTraits<TS>::max_value;
+
+    for (int y = 0; y < src.getImageHeight(); ++y) {
+        const TS *src_pixel = src.row(y);
+        TD *dst_pixel = dst.row(y);
+        for (int x = 0; x < src.getImageWidth(); ++x, src_pixel += CS, dst_pixel += CD) {
+            if constexpr (CS == CD) {
+                for (int c = 0; c < CS; ++c)
+                    dst_pixel[c] = channel_from_float<TD>(src_pixel[c] * scale);
+            } else if constexpr (CS == 1) {
+                const TD level = channel_from_float<TD>(src_pixel[0] * scale);
+                dst_pixel[Image::R] = level;
+                dst_pixel[Image::G] = level;
+                dst_pixel[Image::B] = level;
+                dst_pixel[Image::A] = (TD) ChannelTraits<TD>::max_value;
+            } else {
+                const float sum = (float) src_pixel[Image::R] + (float) src_pixel[Image::G] + (float) src_pixel[Image::B];
+                dst_pixel[0] = channel_from_float<TD>(sum / 3.f * scale);
+            }
+        }
+    }
+}
+
+#endif // ADVANCED_IMAGE_PROCESSOR_TYPED_IMAGE_H__
@@ -5,27 +5,13 @@
 #include <random>
 #include <thread>
 
-#include <imgui.h>
-
-static std::mt19937 rng;
+// one generator per thread, random_seed() seeds the one of the calling thread
+static thread_local std::mt19937 rng;
 
 int nearest_power_of_2(int num) {
     return round(exp2(round(log2(num))));
 }
 
-ImVec2 compute_max_target_size(const ImVec2 &target_size, const ImVec2 &box_size) {
-    if (target_size.x <= box_size.x && target_size.y <= box_size.y)
-        return target_size;
-
-    const float target_aspect_ratio = target_size.x / target_size.y;
-    const float box_aspect_ratio = box_size.x / box_size.y;
-
-    if (target_aspect_ratio > box_aspect_ratio) // target is wider
-        return ImVec2(box_size.x, box_size.x / target_aspect_ratio);
-    else  // target is taller
-        return ImVec2(box_size.y * target_aspect_ratio, box_size.y);
-}
-
 void random_seed(int seed) {
     rng.seed(seed);
 }
@@ -3,8 +3,6 @@
 
 #include <numbers>
 
-#include <imgui.h>
-
 /* Utility Functions */
 
 constexpr double degree_to_radius(double degree) {
@@ -23,8 +21,6 @@ constexpr T partition(T a, T b, double t) {
 
 int nearest_power_of_2(int num);
 
-ImVec2 compute_max_target_size(const ImVec2 &target_size, const ImVec2 &box_size);
-
 void random_seed(int seed);
 double random_float();
 double random_float(double min, double max);
@@ -1,5 +1,6 @@
 #include "view.h"
 
+#include <cstddef>
 #include <iostream>
 
 #include <GLFW/glfw3.h>
@@ -9,7 +10,10 @@
 #include <font_source_han_sans_tc_regular_bsae85.h>
 
 #include "handlers.h"
+#include "jobs.h"
 #include "models.h"
+#include "pixel_kernels.h"
+#include "result_cache.h"
 #include "utility.h"
 
 static const ImVec4 color_error(1.f, 0.f, 0.f, 1.f);
@@ -121,6 +125,9 @@ void view_loop() {
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
+        // show results of finished jobs
+        JobQueue::instance().runCompletions();
+
         // main menu bar
 
         static bool show_imgui_demo_window = false;
@@ -137,8 +144,20 @@ void view_loop() {
             if (ImGui::BeginMenu("Debug")) {
                 ImGui::Checkbox("Show FPS", &show_fps);
                 ImGui::Checkbox("Show ImGUI Demo Window", &show_imgui_demo_window);
+                ImGui::Text("Pixel kernels: %s", cpu_level_name(get_pixel_kernels().level));
+                ImGui::Separator();
+                // results of repeated operations are taken from the cache
+                ResultCache &result_cache = ResultCache::instance();
+                int budget_mb = (int) (result_cache.getBudget() >> 20);
+                if (ImGui::DragInt("Result cache budget (MB)", &budget_mb, 16.f, 0, 65536))
+                    result_cache.setBudget((std::size_t) budget_mb << 20);
+                ImGui::Text("%d result(s), %.1f MB", result_cache.getCount(), result_cache.getSize() / 1048576.);
+                if (ImGui::MenuItem("Clear result cache")) { result_cache.clear(); }
                 ImGui::EndMenu();
             }
+            const int active_job_count = JobQueue::instance().getActiveCount();
+            if (active_job_count > 0)
+                ImGui::TextColored(ImVec4(1.f, 1.f, 1.f, .5f), "Running %d job(s)...", active_job_count);
             if (show_fps) {
                 ImGui::PushID("show fps");
                 ImGui::InvisibleButton("", ImVec2(-80, 20));
@@ -174,17 +193,21 @@ void view_loop() {
             }
 
             if (is_expanded) {
+                // a lazy image is computed once it is displayed
+                image_window->evaluate();
+                const bool is_evaluated = image_window->isEvaluated();
+
                 // menu bar
                 if (ImGui::BeginMenuBar()) {
                     if (ImGui::BeginMenu("File")) {
                         if (ImGui::MenuItem("Save as...")) {
-                            handle_save_iamge(image_window->getImage());
+                            handle_save_iamge(image_window->getLazyImage());
                         }
                         ImGui::Separator();
                         if (ImGui::MenuItem("Copy title to clipboard")) {
                             handle_copy_image_title(image_window);
                         }
-                        if (ImGui::MenuItem("Copy image to clipboard")) {
+                        if (ImGui::MenuItem("Copy image to clipboard", nullptr, false, is_evaluated)) {
                             handle_copy_image_to_clipboard(image_window->getImage());
                         }
                         ImGui::Separator();
@@ -234,7 +257,7 @@ void view_loop() {
 
                         ImGui::EndMenu();
                     }
-                    if (ImGui::BeginMenu("Operations")) {
+                    if (ImGui::BeginMenu("Operations", is_evaluated)) {
                         if (ImGui::BeginMenu("Resize")) {
                             static int new_size[2] = {256, 256};
                             bool error = false;
@@ -245,27 +268,31 @@ void view_loop() {
                             }
                             if (error) ImGui::BeginDisabled();
                             if (ImGui::Button("Apply")) {
-                                handle_resize_image(image_window->getImage(), new_size[0], new_size[1]);
+                                image_window->addOperation("Resize",
+                                        handle_resize_image(image_window->getImage(), new_size[0], new_size[1]));
                             }
                             if (error) ImGui::EndDisabled();
                             ImGui::EndMenu();
                         }
                         if (ImGui::MenuItem("Gray Histogram")) {
-                            handle_gray_histogram(image_window->getImage());
+                            image_window->addOperation("Gray Histogram", handle_gray_histogram(image_window->getImage()));
                             ImGui::EndMenu();
                         }
                         if (ImGui::BeginMenu("Gaussian Noise")) {
                             static int sigma = 32;
+                            static int seed = 0;
                             constexpr float drag_speed = 0.2f;
                             bool error = false;
                             ImGui::DragScalar("sigma", ImGuiDataType_U8, &sigma, drag_speed);
+                            ImGui::InputInt("seed", &seed);
                             if (sigma < 0) {
                                 ImGui::TextColored(color_error, "Error: sigma must >= 0");
                                 error = true;
                             }
                             if (error) ImGui::BeginDisabled();
                             if (ImGui::Button("Apply")) {
-                                handle_gaussian_noise(image_window->getImage(), sigma);
+                                image_window->addOperation("Gaussian Noise",
+                                        handle_gaussian_noise(image_window->getImage(), sigma, (uint32_t) seed));
                             }
                             if (error) ImGui::EndDisabled();
                             ImGui::EndMenu();
@@ -287,13 +314,14 @@ void view_loop() {
                             }
                             if (error) ImGui::BeginDisabled();
                             if (ImGui::Button("Apply")) {
-                                handle_haar_wavelet_transform(image_window->getImage(), level, scale);
+                                image_window->addOperation("HAAR Wavelet Transform",
+                                        handle_haar_wavelet_transform(image_window->getImage(), level, scale));
                             }
                             if (error) ImGui::EndDisabled();
                             ImGui::EndMenu();
                         }
                         if (ImGui::MenuItem("Histogram Equalization")) {
-                            handle_histogram_equalization(image_window->getImage());
+                            image_window->addOperation("Histogram Equalization", handle_histogram_equalization(image_window->getImage()));
                         }
                         if (ImGui::BeginMenu("Convolution")) {
                             static int template_id = 0;
@@ -375,7 +403,8 @@ void view_loop() {
                             }
                             ImGui::PopStyleVar();
                             if (ImGui::Button("Apply")) {
-                                handle_convolution(image_window->getImage(), kernel_size, kernel, edge_handling_method);
+                                image_window->addOperation("Convolution",
+                                        handle_convolution(image_window->getImage(), kernel_size, kernel, edge_handling_method));
                             }
                             ImGui::EndMenu();
                         }
@@ -384,9 +413,23 @@ void view_loop() {
                     ImGui::EndMenuBar();
                 }
 
+                // progress of operations started from this window
+                image_window->removeFinishedOperations();
+                for (const ImageWindow::Operation &operation : image_window->getOperations()) {
+                    ImGui::PushID(operation.progress.get());
+                    ImGui::ProgressBar(operation.progress->getFraction(), ImVec2(-80.f, 0.f), operation.name.c_str());
+                    ImGui::SameLine();
+                    const bool is_canceled = operation.progress->isCanceled();
+                    if (is_canceled) ImGui::BeginDisabled();
+                    if (ImGui::Button("Cancel", ImVec2(-1.f, 0.f))) {
+                        operation.progress->cancel();
+                    }
+                    if (is_canceled) ImGui::EndDisabled();
+                    ImGui::PopID();
+                }
+
                 // set initial zoom mode
-                const ImVec2 image_size = ImVec2(
-                    image_window->getImage()->getImageWidth(), image_window->getImage()->getImageHeight());
+                const ImVec2 image_size = ImVec2(image_window->getImageWidth(), image_window->getImageHeight());
                 ImVec2 render_size;
                 if (image_window->is_first_seen) {
                     constexpr float max_image_ratio = 0.75f;
@@ -405,8 +448,13 @@ void view_loop() {
                 // update scale factor
                 image_window->scale_factor = render_size.x / image_size.x;
 
-                // draw image
-                ImGui::Image((void *)(intptr_t)image_window->getImage()->getTextureId(), render_size);
+                // draw image, uploading pixels changed since the last frame
+                if (is_evaluated) {
+                    image_window->updateTexture();
+                    ImGui::Image((void *)(intptr_t)image_window->getTextureId(), render_size);
+                } else {
+                    ImGui::Dummy(render_size);
+                }
             }
             ImGui::End();
 
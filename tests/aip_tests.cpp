@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "algorithms.h"
+#include "cpu_features.h"
+#include "image.h"
+#include "image_view.h"
+#include "pixel_kernels.h"
+#include "tile_pipeline.h"
+
+/*
+ * Checks of the processing core which compare the paths giving the same
+ * pixels: the pixel kernels of each instruction set level, the tile
+ * pipeline against whole-image operations, and the convolution methods
+ * against the direct one. Prints the failed checks, exits with 1 if any.
+ */
+
+static int failure_count = 0;
+
+static void check(bool condition, const std::string &name) {
+    if (!condition) {
+        std::cout << "FAILED: " << name << std::endl;
+        ++failure_count;
+    }
+}
+
+static const char *edge_name(ConvolutionEdgeHandlingMethod edge_handling_method) {
+    switch (edge_handling_method) {
+    case ConvolutionEdgeHandlingMethod::WRAP:
+        return "wrap";
+    case ConvolutionEdgeHandlingMethod::MIRROR:
+        return "mirror";
+    default:
+        return "extend";
+    }
+}
+
+static const ConvolutionEdgeHandlingMethod edge_handling_methods[] = {
+    ConvolutionEdgeHandlingMethod::EXTEND, ConvolutionEdgeHandlingMethod::WRAP, ConvolutionEdgeHandlingMethod::MIRROR};
+
+static Image random_image(int width, int height, std::mt19937 &rng) {
+    Image image(width, height, Image::INIT_UNINITIALIZED);
+    const ImageView pixels = image.view();
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width * 4; ++x)
+            pixels.row(y)[x] = (uint8_t) rng();
+    }
+    return image;
+}
+
+// random weights summing to 1, with a few negative ones
+static std::vector<float> random_kernel(int kernel_size, std::mt19937 &rng) {
+    std::uniform_real_distribution<float> distribution(-.2f, 1.f);
+    std::vector<float> kernel(kernel_size * kernel_size);
+    float sum = 0.f;
+    for (float &weight : kernel) {
+        weight = distribution(rng);
+        sum += weight;
+    }
+    for (float &weight : kernel)
+        weight /= sum;
+    return kernel;
+}
+
+// outer product of two random vectors, normalized to sum to 1
+static std::vector<float> random_separable_kernel(int kernel_size, std::mt19937 &rng) {
+    std::uniform_real_distribution<float> distribution(.1f, 1.f);
+    std::vector<float> column(kernel_size), row(kernel_size);
+    float column_sum = 0.f, row_sum = 0.f;
+    for (int i = 0; i < kernel_size; ++i) {
+        column_sum += column[i] = distribution(rng);
+        row_sum += row[i] = distribution(rng);
+    }
+    std::vector<float> kernel(kernel_size * kernel_size);
+    for (int i = 0; i < kernel_size; ++i) {
+        for (int j = 0; j < kernel_size; ++j)
+            kernel[i * kernel_size + j] = column[i] / column_sum * (row[j] / row_sum);
+    }
+    return kernel;
+}
+
+// largest difference of a channel between two images of the same size
+static int max_difference(const Image &image, const Image &other) {
+    int difference = 0;
+    for (int y = 0; y < image.getImageHeight(); ++y) {
+        const uint8_t *row = image.view().row(y);
+        const uint8_t *other_row = other.view().row(y);
+        for (int x = 0; x < image.getImageWidth() * 4; ++x)
+            difference = std::max(difference, std::abs(row[x] - other_row[x]));
+    }
+    return difference;
+}
+
+static void test_pixel_kernel_levels() {
+    std::mt19937 rng(1);
+    const PixelKernels &generic = get_pixel_kernels(CpuLevel::GENERIC);
+
+    // rows of odd widths, so the vector loops and their tails both run
+    constexpr int width = 1001;
+    std::vector<uint8_t> pixels(width * 4);
+    for (uint8_t &value : pixels)
+        value = (uint8_t) rng();
+    uint8_t lut[256];
+    for (int i = 0; i < 256; ++i)
+        lut[i] = (uint8_t) (255 - i / 2);
+
+    // images to resize, up and down, gray and RGBA
+    constexpr int image_width = 123;
+    constexpr int image_height = 77;
+    std::vector<uint8_t> image(image_width * image_height * 4);
+    std::vector<float> float_image(image.size());
+    for (std::size_t i = 0; i < image.size(); ++i) {
+        image[i] = (uint8_t) rng();
+        float_image[i] = image[i] / 255.f;
+    }
+    const int out_sizes[][2] = {{64, 32}, {250, 181}, {123, 40}};
+
+    for (int level = (int) CpuLevel::SSE2; level <= (int) detect_cpu_level(); ++level) {
+        const PixelKernels &kernels = get_pixel_kernels((CpuLevel) level);
+        const std::string name = cpu_level_name((CpuLevel) level);
+
+        std::vector<uint8_t> expected(width * 4), result(width * 4);
+        generic.lookup_table_row(pixels.data(), expected.data(), width, lut);
+        kernels.lookup_table_row(pixels.data(), result.data(), width, lut);
+        check(expected == result, name + " lookup_table_row");
+
+        for (int channels : {1, 4}) {
+            for (const int *out_size : out_sizes) {
+                const std::string resize_name = name + " resize of " + std::to_string(channels) + " channels to "
+                        + std::to_string(out_size[0]) + "x" + std::to_string(out_size[1]);
+                const std::size_t out_count = (std::size_t) out_size[0] * out_size[1] * channels;
+
+                std::vector<uint8_t> expected_image(out_count), result_image(out_count);
+                generic.resize(image.data(), image_width, image_height, 0,
+                        expected_image.data(), out_size[0], out_size[1], 0, channels);
+                kernels.resize(image.data(), image_width, image_height, 0,
+                        result_image.data(), out_size[0], out_size[1], 0, channels);
+                check(expected_image == result_image, resize_name);
+
+                std::vector<float> expected_float_image(out_count), result_float_image(out_count);
+                generic.resize_float(float_image.data(), image_width, image_height, 0,
+                        expected_float_image.data(), out_size[0], out_size[1], 0, channels);
+                kernels.resize_float(float_image.data(), image_width, image_height, 0,
+                        result_float_image.data(), out_size[0], out_size[1], 0, channels);
+                check(expected_float_image == result_float_image, resize_name + " (float)");
+            }
+        }
+    }
+}
+
+static void test_tile_pipeline() {
+    std::mt19937 rng(2);
+    // wider than a tile and not a multiple of the tile size in either direction
+    const Image image = random_image(TilePipeline::tile_width + 77, 3 * TilePipeline::tile_height + 5, rng);
+    const std::vector<float> kernel = random_kernel(5, rng);
+    const std::vector<float> separable_kernel = random_separable_kernel(7, rng);
+    uint8_t lut[256];
+    for (int i = 0; i < 256; ++i)
+        lut[i] = (uint8_t) std::min(255, i * 3 / 2);
+
+    for (ConvolutionEdgeHandlingMethod edge_handling_method : edge_handling_methods) {
+        TilePipeline pipeline;
+        pipeline.addConvolution(5, kernel.data(), edge_handling_method);
+        pipeline.addLookupTable(lut);
+        pipeline.addConvolution(7, separable_kernel.data(), edge_handling_method);
+        pipeline.addHistogramEqualization();
+
+        Image expected(image.getImageWidth(), image.getImageHeight(), Image::INIT_UNINITIALIZED);
+        Image step(image.getImageWidth(), image.getImageHeight(), Image::INIT_UNINITIALIZED);
+        image_convolution(image.view(), expected.view(), 5, kernel.data(), edge_handling_method);
+        apply_lookup_table(std::as_const(expected).view(), expected.view(), lut);
+        image_convolution(std::as_const(expected).view(), step.view(), 7, separable_kernel.data(), edge_handling_method);
+        histogram_equalization(std::as_const(step).view(), expected.view());
+
+        Image result(image.getImageWidth(), image.getImageHeight(), Image::INIT_UNINITIALIZED);
+        pipeline.run(image.view(), result.view());
+        check(max_difference(expected, result) == 0, std::string("tile pipeline, ") + edge_name(edge_handling_method));
+    }
+}
+
+static void test_convolution_methods() {
+    std::mt19937 rng(3);
+    const Image image = random_image(301, 203, rng);
+
+    for (ConvolutionEdgeHandlingMethod edge_handling_method : edge_handling_methods) {
+        for (int kernel_size : {3, 5, 7, 9, 31}) {
+            const std::string name = std::string(edge_name(edge_handling_method)) + ", kernel size "
+                    + std::to_string(kernel_size);
+            const std::vector<float> kernels[] = {
+                random_separable_kernel(kernel_size, rng), random_kernel(kernel_size, rng)};
+            for (const std::vector<float> &kernel : kernels) {
+                const bool is_separable = &kernel == &kernels[0];
+                const std::string kernel_name = name + (is_separable ? ", separable" : ", general");
+
+                Image direct(image.getImageWidth(), image.getImageHeight(), Image::INIT_UNINITIALIZED);
+                image_convolution(image.view(), direct.view(), kernel_size, kernel.data(), edge_handling_method,
+                        ConvolutionMethod::DIRECT);
+
+                // the separable passes round like the direct sums, within 1 level
+                Image result(image.getImageWidth(), image.getImageHeight(), Image::INIT_UNINITIALIZED);
+                if (is_separable) {
+                    check(image_convolution(image.view(), result.view(), kernel_size, kernel.data(),
+                            edge_handling_method, ConvolutionMethod::SEPARABLE), kernel_name + ", separable runs");
+                    check(max_difference(direct, result) <= 1, kernel_name + ", separable against direct");
+                }
+
+                check(image_convolution(image.view(), result.view(), kernel_size, kernel.data(),
+                        edge_handling_method, ConvolutionMethod::FFT), kernel_name + ", FFT runs");
+                check(max_difference(direct, result) <= 1, kernel_name + ", FFT against direct");
+
+                // the method image_convolution picks, the FFT for the general 31 x 31 kernel
+                if (kernel_size == 31 && !is_separable) {
+                    check(convolution_uses_fft(image.getImageWidth(), image.getImageHeight(), kernel_size, kernel.data()),
+                            kernel_name + ", FFT picked");
+                }
+                image_convolution(image.view(), result.view(), kernel_size, kernel.data(), edge_handling_method);
+                check(max_difference(direct, result) <= 1, kernel_name + ", fastest against direct");
+            }
+        }
+    }
+}
+
+int main() {
+    test_pixel_kernel_levels();
+    test_tile_pipeline();
+    test_convolution_methods();
+
+    if (failure_count > 0) {
+        std::cout << failure_count << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}